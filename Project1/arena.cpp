@@ -0,0 +1,72 @@
+/*
+ * arena.cpp
+ */
+
+#include "arena.h"
+#include <stdlib.h>
+
+namespace {
+	char* alignUp(char* p)
+	{
+		return (char*)(((size_t)p + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1));
+	}
+
+	//Starts a new block of at least size usable bytes
+	void addBlock(Arena& arena, size_t size)
+	{
+		size_t blockSize = arena.blockSize == 0 ? ARENA_FIRST_BLOCK : arena.blockSize*2;
+		if(blockSize < size + ARENA_ALIGNMENT)
+			blockSize = size + ARENA_ALIGNMENT;
+
+		char* block = (char*)malloc(blockSize);
+		arena.blocks.push_back(block);
+		arena.blockSize = blockSize;
+		arena.next = block;
+		arena.end = block + blockSize;
+		arena.reserved += blockSize;
+		arena.blockAllocations++;
+	}
+}
+
+Arena::~Arena()
+{
+	freeArena(*this);
+}
+
+void* arenaAlloc(Arena& arena, size_t size)
+{
+	char* start = alignUp(arena.next);
+	if(arena.next == NULL || start + size > arena.end)
+	{
+		addBlock(arena, size);
+		start = alignUp(arena.next);
+	}
+	arena.next = start + size;
+	arena.used += size;
+	return start;
+}
+
+void resetArena(Arena& arena)
+{
+	if(arena.blocks.size() > 1)
+	{
+		/* Everything would have fitted in one block this big */
+		size_t size = arena.reserved;
+		freeArena(arena);
+		arena.blockSize = size/2;
+		addBlock(arena, size - ARENA_ALIGNMENT);
+	} else if(!arena.blocks.empty()) {
+		arena.next = arena.blocks[0];
+	}
+	arena.used = 0;
+}
+
+void freeArena(Arena& arena)
+{
+	for(size_t i = 0; i < arena.blocks.size(); i++)
+		free(arena.blocks[i]);
+	arena.blocks.clear();
+	arena.blockSize = 0;
+	arena.next = arena.end = NULL;
+	arena.used = arena.reserved = 0;
+}
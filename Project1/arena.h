@@ -0,0 +1,55 @@
+/*
+ * arena.h
+ *
+ * A bump allocator: memory is handed out from the front of a block by moving a
+ * pointer along, and is only given back all at once by resetting it. Whatever
+ * belongs together (a level's grid and its rings, say) sits side by side, and
+ * throwing it away costs one reset instead of a free per allocation.
+ *
+ * If a block fills up another is added. Resetting an arena with several blocks
+ * swaps them for one block as big as all of them, so once it has seen its
+ * largest contents it only ever uses one.
+ */
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+#include <vector>
+
+#define ARENA_ALIGNMENT 32 // Allocations start on a boundary of this many bytes
+#define ARENA_FIRST_BLOCK (64*1024)
+
+struct Arena{
+	std::vector<char*> blocks;
+	size_t blockSize;  // Of the newest block
+	char* next;        // First free byte in the newest block
+	char* end;
+	size_t used;       // Bytes handed out since the last reset
+	size_t reserved;   // Bytes in all the blocks
+	unsigned int blockAllocations; // Blocks ever taken from the heap
+
+	Arena() : blockSize(0), next(NULL), end(NULL), used(0), reserved(0), blockAllocations(0) {}
+	~Arena();
+
+private:
+	Arena(const Arena&);
+	Arena& operator=(const Arena&);
+};
+
+//Returns size bytes, aligned to ARENA_ALIGNMENT, that stay valid until the arena is reset
+void* arenaAlloc(Arena& arena, size_t size);
+
+//Allocates count Ts (which must need no destructor) from the arena
+template <typename T> T* arenaAlloc(Arena& arena, size_t count)
+{
+	return (T*)arenaAlloc(arena, count*sizeof(T));
+}
+
+//Gives back everything allocated, keeping the memory for reuse
+void resetArena(Arena& arena);
+
+//Gives back everything allocated and frees the memory
+void freeArena(Arena& arena);
+
+#endif /* ARENA_H_ */
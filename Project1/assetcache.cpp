@@ -0,0 +1,183 @@
+/*
+ * assetcache.cpp
+ */
+
+#include "assetcache.h"
+#include "meshbuffer.h"
+#include "meshpack.h"
+#include "platform.h"
+#include "texupload.h"
+#include <stdio.h>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+	/* The cache only holds weak references, so it never keeps an asset alive */
+	struct AssetCache{
+		std::mutex lock;
+		std::unordered_map<std::string, std::weak_ptr<Mesh> > meshes;
+		std::unordered_map<std::string, std::weak_ptr<Texture> > textures;
+		AssetCacheStats stats;
+
+		AssetCache()
+		{
+			stats.hits = stats.misses = 0;
+			stats.meshes = stats.textures = 0;
+			stats.resident_bytes = 0;
+		}
+	};
+
+	/* Never destroyed, so handles held in other files' globals can still be
+	   released safely at exit */
+	AssetCache& getCache(void)
+	{
+		static AssetCache* cache = new AssetCache;
+		return *cache;
+	}
+
+	size_t meshBytes(const Mesh& mesh)
+	{
+		size_t bytes = mesh.faces.size()*sizeof(Face) + mesh.vertices.size()*sizeof(Vector3f)
+			+ mesh.vertex_normals.size()*sizeof(Vector3f) + mesh.tex_coords.size()*sizeof(Vector2f);
+		for(size_t i = 0; i < mesh.lod_indices.size(); i++)
+			bytes += mesh.lod_indices[i].size()*sizeof(unsigned int);
+		if(mesh.packed)
+			bytes += packedMeshBytes(*mesh.packed);
+		return bytes + mesh.buffer_bytes;
+	}
+
+	/* Removes the cache entry for key, unless it has already been replaced by a
+	   newer load of the same file */
+	template<class Asset>
+	void forget(std::unordered_map<std::string, std::weak_ptr<Asset> >& entries, const std::string& key)
+	{
+		typename std::unordered_map<std::string, std::weak_ptr<Asset> >::iterator entry = entries.find(key);
+		if(entry != entries.end() && entry->second.expired())
+			entries.erase(entry);
+	}
+
+	struct MeshDeleter{
+		std::string key;
+		size_t bytes;
+
+		MeshDeleter(const std::string& key, size_t bytes) : key(key), bytes(bytes) {}
+
+		void operator()(Mesh* mesh)
+		{
+			freeMeshBuffers(*mesh);
+			delete mesh;
+
+			AssetCache& cache = getCache();
+			std::lock_guard<std::mutex> guard(cache.lock);
+			forget(cache.meshes, key);
+			cache.stats.meshes--;
+			cache.stats.resident_bytes -= bytes;
+		}
+	};
+
+	struct TextureDeleter{
+		std::string key;
+
+		TextureDeleter(const std::string& key) : key(key) {}
+
+		void operator()(Texture* texture)
+		{
+			size_t bytes = texture->bytes;
+			forgetTexture(texture->name);
+			glDeleteTextures(1, &texture->name);
+			delete texture;
+
+			AssetCache& cache = getCache();
+			std::lock_guard<std::mutex> guard(cache.lock);
+			forget(cache.textures, key);
+			cache.stats.textures--;
+			cache.stats.resident_bytes -= bytes;
+		}
+	};
+}
+
+MeshHandle acquireMesh(const std::string& filename, int threads, Mesh* loaded, int packNormalBits)
+{
+	AssetCache& cache = getCache();
+	std::string key = getCanonicalPath(filename.c_str());
+
+	/* Held while loading too, so two requests for one file can't both load it */
+	std::lock_guard<std::mutex> guard(cache.lock);
+
+	MeshHandle mesh = cache.meshes[key].lock();
+	if(mesh)
+	{
+		cache.stats.hits++;
+		delete loaded;
+		return mesh;
+	}
+	cache.stats.misses++;
+
+	if(loaded == NULL)
+	{
+		loaded = new Mesh;
+		loadMesh(*loaded, filename, threads);
+	}
+	if(loaded->faces.empty())
+	{
+		delete loaded;
+		cache.meshes.erase(key);
+		return MeshHandle();
+	}
+	if(packNormalBits == 0 || !uploadPackedMesh(*loaded, packNormalBits))
+		uploadMesh(*loaded);
+
+	size_t bytes = meshBytes(*loaded);
+	mesh = MeshHandle(loaded, MeshDeleter(key, bytes));
+	cache.meshes[key] = mesh;
+	cache.stats.meshes++;
+	cache.stats.resident_bytes += bytes;
+	return mesh;
+}
+
+TextureHandle acquireTexture(const std::string& filename, TextureLoader loader, void* data)
+{
+	AssetCache& cache = getCache();
+	std::string key = getCanonicalPath(filename.c_str());
+
+	std::lock_guard<std::mutex> guard(cache.lock);
+
+	TextureHandle texture = cache.textures[key].lock();
+	if(texture)
+	{
+		cache.stats.hits++;
+		return texture;
+	}
+	cache.stats.misses++;
+
+	Texture* loaded = new Texture;
+	glGenTextures(1, &loaded->name);
+	if(!loader(*loaded, filename.c_str(), data))
+	{
+		printf("Could not load texture %s\n", filename.c_str());
+		glDeleteTextures(1, &loaded->name);
+		delete loaded;
+		cache.textures.erase(key);
+		return TextureHandle();
+	}
+
+	texture = TextureHandle(loaded, TextureDeleter(key));
+	cache.textures[key] = texture;
+	cache.stats.textures++;
+	cache.stats.resident_bytes += loaded->bytes;
+	return texture;
+}
+
+AssetCacheStats getAssetCacheStats(void)
+{
+	AssetCache& cache = getCache();
+	std::lock_guard<std::mutex> guard(cache.lock);
+	return cache.stats;
+}
+
+void printAssetCacheStats(void)
+{
+	AssetCacheStats stats = getAssetCacheStats();
+	printf("Asset cache: %u hits, %u misses, %d meshes and %d textures resident in %.1f KB\n",
+		stats.hits, stats.misses, stats.meshes, stats.textures, stats.resident_bytes/1024.0);
+}
@@ -0,0 +1,61 @@
+/*
+ * assetcache.h
+ *
+ * Shared meshes and textures. Each file is loaded once however many times it
+ * is asked for: requests are keyed by canonical path and return reference
+ * counted handles to the one copy, which is freed (GPU buffers and textures
+ * included) when the last handle goes away.
+ *
+ * Handles must be released on the thread that owns the GL context, since the
+ * last release deletes GL objects.
+ */
+
+#ifndef ASSETCACHE_H_
+#define ASSETCACHE_H_
+
+#include <memory>
+#include <string>
+#include "mesh.h"
+
+struct Texture{
+	GLuint name;  // GL texture object, generated by the cache
+	int width;
+	int height;
+	size_t bytes; // Estimated GPU memory, mipmaps included
+
+	Texture() : name(0), width(0), height(0), bytes(0) {}
+};
+
+typedef std::shared_ptr<Mesh> MeshHandle;
+typedef std::shared_ptr<Texture> TextureHandle;
+
+//Uploads the image for a texture. The texture object has already been generated
+//(but not bound); the loader fills in width, height and bytes and returns false
+//on failure. filename and data are as passed to acquireTexture
+typedef bool (*TextureLoader)(Texture& texture, const char* filename, void* data);
+
+struct AssetCacheStats{
+	unsigned int hits;     // Requests answered with an asset that was already resident
+	unsigned int misses;   // Requests that had to load
+	int meshes;            // Assets currently resident
+	int textures;
+	size_t resident_bytes; // CPU and GPU memory held by resident assets
+};
+
+//Returns the mesh loaded from filename (see loadMesh) and uploaded to the GPU,
+//loading it only if it isn't already resident. Returns an empty handle if the
+//file can't be loaded. If loaded is given it is filename already read by
+//loadMesh (on a worker thread, say), which the cache takes ownership of and
+//uses instead of loading the file again. packNormalBits (8 or 16) keeps a newly
+//loaded mesh in the compact format (see uploadPackedMesh) instead of as loaded
+MeshHandle acquireMesh(const std::string& filename, int threads = 1, Mesh* loaded = NULL, int packNormalBits = 0);
+
+//Returns the texture for filename, calling loader (with data) to create it only
+//if it isn't already resident. Names that aren't files (generated textures) are
+//used as keys as they are. Returns an empty handle if the loader fails
+TextureHandle acquireTexture(const std::string& filename, TextureLoader loader, void* data = NULL);
+
+AssetCacheStats getAssetCacheStats(void);
+void printAssetCacheStats(void);
+
+#endif /* ASSETCACHE_H_ */
@@ -0,0 +1,221 @@
+/*
+ * atlas.cpp
+ */
+
+#include "atlas.h"
+#include <math.h>
+#include <string.h>
+
+namespace {
+	/* Which of size texels wrapping would fetch for texel x of a tile */
+	int wrapTexel(int x, int size, AtlasWrap wrap)
+	{
+		if(wrap == atlasRepeat)
+			return ((x % size) + size) % size;
+
+		int period = 2*size;
+		int m = ((x % period) + period) % period;
+		return m < size ? m : period - 1 - m;
+	}
+
+	/* Fills the gutter around the size x size tile whose first pixel is at
+	   (originX, originY) in an RGBA image width pixels wide */
+	void fillGutter(unsigned char* pixels, int width, int originX, int originY, int size, int gutter, AtlasWrap wrap)
+	{
+		if(gutter <= 0)
+			return;
+		for(int y = -gutter; y < size + gutter; y++)
+		{
+			unsigned char* row = pixels + ((size_t)(originY + y)*width + originX)*4;
+			const unsigned char* sourceRow = pixels + ((size_t)(originY + wrapTexel(y, size, wrap))*width + originX)*4;
+			bool inside = y >= 0 && y < size;
+			for(int x = -gutter; x < size + gutter; x++)
+			{
+				if(inside && x == 0)
+					x = size; // Only the left and right gutters on rows through the tile
+				memcpy(row + x*4, sourceRow + wrapTexel(x, size, wrap)*4, 4);
+			}
+		}
+	}
+
+	/* Converts a source to a tileSize x tileSize RGBA tile */
+	void makeTile(const AtlasSource& source, int tileSize, std::vector<unsigned char>& tile)
+	{
+		std::vector<unsigned char> rgba;
+		const unsigned char* pixels = source.pixels;
+		if(source.channels != 4)
+		{
+			size_t count = (size_t)source.width*source.height;
+			rgba.resize(count*4);
+			for(size_t i = 0; i < count; i++)
+			{
+				rgba[i*4] = pixels[i*source.channels];
+				rgba[i*4 + 1] = pixels[i*source.channels + 1];
+				rgba[i*4 + 2] = pixels[i*source.channels + 2];
+				rgba[i*4 + 3] = 255;
+			}
+			pixels = &rgba[0];
+		}
+
+		tile.resize((size_t)tileSize*tileSize*4);
+		if(source.width == tileSize && source.height == tileSize)
+			memcpy(&tile[0], pixels, tile.size());
+		else
+			resizeImage(pixels, source.width, source.height, 4, &tile[0], tileSize, tileSize);
+	}
+}
+
+void buildAtlas(const std::vector<AtlasSource>& sources, int tileSize, int gutter, TextureAtlas& atlas)
+{
+	int count = (int)sources.size();
+	int slot = tileSize + 2*gutter;
+
+	/* Smallest power of two grid that fits, as square as possible */
+	atlas.tileSize = tileSize;
+	atlas.gutter = gutter;
+	atlas.columns = 1;
+	while(atlas.columns*atlas.columns < count)
+		atlas.columns *= 2;
+	atlas.rows = atlas.columns;
+	while(atlas.rows > 1 && (atlas.rows/2)*atlas.columns >= count)
+		atlas.rows /= 2;
+
+	int width = atlas.columns*slot;
+	int height = atlas.rows*slot;
+
+	atlas.regions.resize(count);
+	for(int i = 0; i < count; i++)
+	{
+		AtlasRegion& region = atlas.regions[i];
+		int x = (i % atlas.columns)*slot + gutter;
+		int y = (i / atlas.columns)*slot + gutter;
+		region.u0 = (float)x/width;
+		region.v0 = (float)y/height;
+		region.u1 = (float)(x + tileSize)/width;
+		region.v1 = (float)(y + tileSize)/height;
+		region.wrap = sources[i].wrap;
+	}
+
+	/* Lay the levels out as buildMipChain does */
+	MipChain& chain = atlas.chain;
+	chain.channels = 4;
+	chain.levels.clear();
+	size_t total = 0;
+	for(int w = width, h = height; ; w = w > 1 ? w/2 : 1, h = h > 1 ? h/2 : 1)
+	{
+		MipLevel level;
+		level.width = w;
+		level.height = h;
+		level.offset = total;
+		level.size = (size_t)w*h*4;
+		chain.levels.push_back(level);
+		total += level.size;
+		if((w == 1 && h == 1) || chain.levels.size() == MAX_MIP_LEVELS)
+			break;
+	}
+	chain.pixels.assign(total, 0);
+
+	/* Level 0: copy each tile in and wrap it into its gutter */
+	unsigned char* base = &chain.pixels[0];
+	std::vector<unsigned char> tile;
+	for(int i = 0; i < count; i++)
+	{
+		makeTile(sources[i], tileSize, tile);
+		int originX = (i % atlas.columns)*slot + gutter;
+		int originY = (i / atlas.columns)*slot + gutter;
+		for(int y = 0; y < tileSize; y++)
+			memcpy(base + ((size_t)(originY + y)*width + originX)*4, &tile[(size_t)y*tileSize*4], (size_t)tileSize*4);
+		fillGutter(base, width, originX, originY, tileSize, gutter, sources[i].wrap);
+	}
+
+	/* While the tiles still start on even pixels, halving the atlas halves each
+	   tile exactly, and only the gutters (which picked up their neighbours)
+	   need redoing */
+	for(size_t k = 1; k < chain.levels.size(); k++)
+	{
+		const MipLevel& above = chain.levels[k - 1];
+		const MipLevel& level = chain.levels[k];
+		halveImage(&chain.pixels[above.offset], above.width, above.height, 4, &chain.pixels[level.offset]);
+
+		int scale = 1 << k;
+		if(gutter % scale != 0 || tileSize % scale != 0)
+			continue;
+		for(int i = 0; i < count; i++)
+		{
+			int originX = ((i % atlas.columns)*slot + gutter)/scale;
+			int originY = ((i / atlas.columns)*slot + gutter)/scale;
+			fillGutter(&chain.pixels[level.offset], level.width, originX, originY, tileSize/scale, gutter/scale, sources[i].wrap);
+		}
+	}
+}
+
+void addAtlasQuad(const float* vertices, const float* texCoords, const AtlasRegion& region, std::vector<float>& triangles)
+{
+	/* Texture co-ordinates to positions, from the edges either side of corner 0 */
+	float du1 = texCoords[2] - texCoords[0], dv1 = texCoords[3] - texCoords[1];
+	float du3 = texCoords[6] - texCoords[0], dv3 = texCoords[7] - texCoords[1];
+	float det = du1*dv3 - dv1*du3;
+	if(det == 0)
+		return;
+
+	float uMin = texCoords[0], uMax = texCoords[0];
+	float vMin = texCoords[1], vMax = texCoords[1];
+	for(int i = 1; i < 4; i++)
+	{
+		uMin = texCoords[i*2] < uMin ? texCoords[i*2] : uMin;
+		uMax = texCoords[i*2] > uMax ? texCoords[i*2] : uMax;
+		vMin = texCoords[i*2 + 1] < vMin ? texCoords[i*2 + 1] : vMin;
+		vMax = texCoords[i*2 + 1] > vMax ? texCoords[i*2 + 1] : vMax;
+	}
+
+	/* One piece per repeat of the texture */
+	for(int i = (int)floorf(uMin); i < uMax; i++)
+	{
+		float ua = i > uMin ? (float)i : uMin;
+		float ub = i + 1 < uMax ? (float)(i + 1) : uMax;
+		if(ub - ua < 1e-6f)
+			continue;
+		for(int j = (int)floorf(vMin); j < vMax; j++)
+		{
+			float va = j > vMin ? (float)j : vMin;
+			float vb = j + 1 < vMax ? (float)(j + 1) : vMax;
+			if(vb - va < 1e-6f)
+				continue;
+
+			/* Corners of the piece, wound the same way as the quad */
+			float corners[4][2] = {{ua, va}, {ub, va}, {ub, vb}, {ua, vb}};
+			if(det < 0)
+			{
+				corners[1][0] = ua; corners[1][1] = vb;
+				corners[3][0] = ub; corners[3][1] = va;
+			}
+
+			float piece[4][5];
+			for(int c = 0; c < 4; c++)
+			{
+				float u = corners[c][0], v = corners[c][1];
+				float du = u - texCoords[0], dv = v - texCoords[1];
+				float a = (du*dv3 - dv*du3)/det;
+				float b = (du1*dv - dv1*du)/det;
+				for(int axis = 0; axis < 3; axis++)
+					piece[c][axis] = vertices[axis] + a*(vertices[3 + axis] - vertices[axis]) + b*(vertices[9 + axis] - vertices[axis]);
+
+				/* Within the tile, reflected on odd repeats when mirrored */
+				float s = u - i, t = v - j;
+				if(region.wrap == atlasMirroredRepeat)
+				{
+					if(i & 1)
+						s = 1 - s;
+					if(j & 1)
+						t = 1 - t;
+				}
+				piece[c][3] = region.u0 + s*(region.u1 - region.u0);
+				piece[c][4] = region.v0 + t*(region.v1 - region.v0);
+			}
+
+			static const int order[6] = {0, 1, 2, 0, 2, 3};
+			for(int k = 0; k < 6; k++)
+				triangles.insert(triangles.end(), piece[order[k]], piece[order[k]] + 5);
+		}
+	}
+}
@@ -0,0 +1,60 @@
+/*
+ * atlas.h
+ *
+ * Packs several repeating textures into one, so surfaces that used to need a
+ * texture each can be drawn with a single bind and a single draw call.
+ *
+ * An atlas can't rely on GL_REPEAT or GL_MIRRORED_REPEAT, since wrapping would
+ * run into the neighbouring tiles. Instead each quad is cut up where its
+ * texture would repeat, and each piece gets co-ordinates inside its tile,
+ * flipped on alternate pieces for mirrored tiles. Every tile is surrounded by a
+ * gutter of the pixels wrapping would have fetched, so filtering at a tile's
+ * edge still blends with the right neighbours, and the gutter is redone on each
+ * mipmap level until it is a single pixel wide.
+ */
+
+#ifndef ATLAS_H_
+#define ATLAS_H_
+
+#include <vector>
+#include "mipmap.h"
+
+enum AtlasWrap {atlasRepeat, atlasMirroredRepeat};
+
+struct AtlasSource{
+	const unsigned char* pixels; // Tightly packed rows, bottom row first
+	int width;
+	int height;
+	int channels;                // 3 or 4
+	AtlasWrap wrap;
+};
+
+//Where a tile's pixels lie in the atlas, in texture co-ordinates
+struct AtlasRegion{
+	float u0, v0;
+	float u1, v1;
+	AtlasWrap wrap;
+};
+
+struct TextureAtlas{
+	int tileSize;     // Pixels across each tile on level 0, gutter excluded
+	int gutter;
+	int columns;
+	int rows;
+	std::vector<AtlasRegion> regions; // One per source, in order
+	MipChain chain;   // RGBA, down to 1x1
+};
+
+//Resizes each source to tileSize x tileSize and packs them in order.
+//tileSize + 2*gutter must be a power of two, and the gutter no larger than the
+//tile. Levels below the one where the gutter is a single pixel are plain box
+//filters of the whole atlas, so tiles bleed into each other there
+void buildAtlas(const std::vector<AtlasSource>& sources, int tileSize, int gutter, TextureAtlas& atlas);
+
+//Appends the triangles for a quad textured with region, as interleaved x, y, z,
+//u, v. vertices and texCoords are the quad's four corners as they would be
+//drawn with the tile as a texture of its own; the texture must map onto the
+//quad without distortion (a rectangle textured by a rectangle, say)
+void addAtlasQuad(const float* vertices, const float* texCoords, const AtlasRegion& region, std::vector<float>& triangles);
+
+#endif /* ATLAS_H_ */
@@ -0,0 +1,56 @@
+/*
+ * course.cpp
+ */
+
+#include "course.h"
+
+namespace {
+	const char courseMovements[] = {'S', 'S', 'S', 'H', 'V', 'C', 'A'}; // Three in seven still
+
+	//xorshift32, which gives the same numbers on every compiler, unlike rand
+	unsigned int nextRandom(CourseGenerator& course)
+	{
+		unsigned int x = course.state;
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		return course.state = x;
+	}
+
+	//A number from 0 to range - 1
+	int randomBelow(CourseGenerator& course, int range)
+	{
+		return (int)(nextRandom(course) % (unsigned int)range);
+	}
+}
+
+void startCourse(CourseGenerator& course, unsigned int seed, int cols)
+{
+	/* Spread the seed's bits out, since xorshift takes a while to get going from small seeds */
+	course.state = seed*2654435761u ^ 0x9e3779b9u;
+	if(course.state == 0)
+		course.state = 1;
+	course.cols = cols;
+	course.row = 0;
+	course.col = randomBelow(course, cols);
+	course.height = (COURSE_MIN_HEIGHT + COURSE_MAX_HEIGHT)/2;
+}
+
+int nextCourseRow(CourseGenerator& course, LevelCell* cells)
+{
+	/* Step at most one column and a few units of height from the last ring, so it can be flown */
+	int next = course.col + randomBelow(course, 3) - 1;
+	course.col = next < 0 ? 0 : (next >= course.cols ? course.cols - 1 : next);
+	int height = course.height + randomBelow(course, 11) - 5;
+	course.height = height < COURSE_MIN_HEIGHT ? COURSE_MIN_HEIGHT : (height > COURSE_MAX_HEIGHT ? COURSE_MAX_HEIGHT : height);
+	char movement = courseMovements[randomBelow(course, sizeof(courseMovements))];
+
+	for(int col = 0; col < course.cols; col++)
+	{
+		cells[col].height = 0;
+		cells[col].movement = 'S';
+	}
+	cells[course.col].height = (short)course.height;
+	cells[course.col].movement = movement;
+	return course.row++;
+}
@@ -0,0 +1,33 @@
+/*
+ * course.h
+ *
+ * An endless course, made up a row at a time from a seed. Each row has one
+ * ring, in a column next to or the same as the last one and at a height a
+ * little above or below it, with the same movements as the level files (S, H,
+ * V, C and A). The same seed always gives the same course, and making a row
+ * needs nothing but the few numbers below, so a course can go on for ever.
+ */
+
+#ifndef COURSE_H_
+#define COURSE_H_
+
+#include "level.h"
+
+#define COURSE_MIN_HEIGHT 2
+#define COURSE_MAX_HEIGHT 30 // Highest a ring goes, in the units of the level files
+
+struct CourseGenerator{
+	unsigned int state; // Of the random number generator, never 0
+	int cols;
+	int row;            // Rows made so far
+	int col;            // Of the last ring
+	int height;         // Of the last ring
+};
+
+//Starts the course seed gives, cols wide
+void startCourse(CourseGenerator& course, unsigned int seed, int cols);
+
+//Fills cells (cols of them) with the next row, returning its number
+int nextCourseRow(CourseGenerator& course, LevelCell* cells);
+
+#endif /* COURSE_H_ */
@@ -0,0 +1,73 @@
+/*
+ * glfuncs.cpp
+ */
+
+#include "glfuncs.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <GL/glx.h>
+#endif
+
+GenBuffersFunc pglGenBuffers = NULL;
+DeleteBuffersFunc pglDeleteBuffers = NULL;
+BindBufferFunc pglBindBuffer = NULL;
+BufferDataFunc pglBufferData = NULL;
+MapBufferFunc pglMapBuffer = NULL;
+UnmapBufferFunc pglUnmapBuffer = NULL;
+
+int glBuffersSupported = FALSE;
+int glPixelBuffersSupported = FALSE;
+
+namespace {
+	//Finds a function by its core name, falling back on the ARB extension name
+	void *getGlFunction(const char *name, const char *arbName)
+	{
+		void *function;
+#ifdef _WIN32
+		function = (void *)wglGetProcAddress(name);
+		if(function == NULL)
+			function = (void *)wglGetProcAddress(arbName);
+#else
+		function = (void *)glXGetProcAddressARB((const GLubyte *)name);
+		if(function == NULL)
+			function = (void *)glXGetProcAddressARB((const GLubyte *)arbName);
+#endif
+		return function;
+	}
+
+	//Whether the context is at least the given version or has the extension
+	bool glHasFeature(int major, int minor, const char *extension)
+	{
+		const char *version = (const char *)glGetString(GL_VERSION);
+		int haveMajor = 0, haveMinor = 0;
+		if(version != NULL && sscanf(version, "%d.%d", &haveMajor, &haveMinor) == 2
+			&& (haveMajor > major || (haveMajor == major && haveMinor >= minor)))
+			return true;
+
+		const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+		return extensions != NULL && strstr(extensions, extension) != NULL;
+	}
+}
+
+void initGlFunctions(void)
+{
+	pglGenBuffers = (GenBuffersFunc)getGlFunction("glGenBuffers", "glGenBuffersARB");
+	pglDeleteBuffers = (DeleteBuffersFunc)getGlFunction("glDeleteBuffers", "glDeleteBuffersARB");
+	pglBindBuffer = (BindBufferFunc)getGlFunction("glBindBuffer", "glBindBufferARB");
+	pglBufferData = (BufferDataFunc)getGlFunction("glBufferData", "glBufferDataARB");
+
+	glBuffersSupported = pglGenBuffers != NULL && pglDeleteBuffers != NULL && pglBindBuffer != NULL && pglBufferData != NULL;
+
+	if(!glBuffersSupported)
+		puts("Vertex buffer objects not supported, using immediate mode");
+
+	pglMapBuffer = (MapBufferFunc)getGlFunction("glMapBuffer", "glMapBufferARB");
+	pglUnmapBuffer = (UnmapBufferFunc)getGlFunction("glUnmapBuffer", "glUnmapBufferARB");
+	glPixelBuffersSupported = glBuffersSupported && pglMapBuffer != NULL && pglUnmapBuffer != NULL
+		&& glHasFeature(2, 1, "GL_ARB_pixel_buffer_object");
+
+	if(!glPixelBuffersSupported)
+		puts("Pixel buffer objects not supported, uploading textures straight from memory");
+}
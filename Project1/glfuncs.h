@@ -0,0 +1,69 @@
+/*
+ * glfuncs.h
+ *
+ * The Windows OpenGL headers stop at version 1.1, so anything newer has to be
+ * fetched from the driver at run time. initGlFunctions() must be called once a
+ * GL context exists (i.e. after glutCreateWindow).
+ */
+
+#ifndef GLFUNCS_H_
+#define GLFUNCS_H_
+
+#include <stddef.h>
+#include <Windows.h>
+#include <GL/gl.h>
+
+/* Buffer object tokens (OpenGL 1.5 / ARB_vertex_buffer_object) */
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#endif
+#ifndef GL_ELEMENT_ARRAY_BUFFER
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#endif
+#ifndef GL_STATIC_DRAW
+#define GL_STATIC_DRAW 0x88E4
+#endif
+
+/* Pixel buffer object tokens (OpenGL 2.1 / ARB_pixel_buffer_object) */
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+#ifndef GL_STREAM_DRAW
+#define GL_STREAM_DRAW 0x88E0
+#endif
+#ifndef GL_WRITE_ONLY
+#define GL_WRITE_ONLY 0x88B9
+#endif
+
+/* Mipmap level range (OpenGL 1.2) */
+#ifndef GL_TEXTURE_BASE_LEVEL
+#define GL_TEXTURE_BASE_LEVEL 0x813C
+#endif
+#ifndef GL_TEXTURE_MAX_LEVEL
+#define GL_TEXTURE_MAX_LEVEL 0x813D
+#endif
+
+typedef void (APIENTRY *GenBuffersFunc)(GLsizei n, GLuint *buffers);
+typedef void (APIENTRY *DeleteBuffersFunc)(GLsizei n, const GLuint *buffers);
+typedef void (APIENTRY *BindBufferFunc)(GLenum target, GLuint buffer);
+typedef void (APIENTRY *BufferDataFunc)(GLenum target, ptrdiff_t size, const void *data, GLenum usage);
+typedef void *(APIENTRY *MapBufferFunc)(GLenum target, GLenum access);
+typedef GLboolean (APIENTRY *UnmapBufferFunc)(GLenum target);
+
+extern GenBuffersFunc pglGenBuffers;
+extern DeleteBuffersFunc pglDeleteBuffers;
+extern BindBufferFunc pglBindBuffer;
+extern BufferDataFunc pglBufferData;
+extern MapBufferFunc pglMapBuffer;
+extern UnmapBufferFunc pglUnmapBuffer;
+
+/* TRUE if all of the buffer object functions above were found */
+extern int glBuffersSupported;
+
+/* TRUE if buffers can also be mapped and used as the source of texture uploads */
+extern int glPixelBuffersSupported;
+
+//Looks up the functions above from the current context
+void initGlFunctions(void);
+
+#endif /* GLFUNCS_H_ */
@@ -0,0 +1,355 @@
+/*
+ * groundstream.cpp
+ */
+
+#include "groundstream.h"
+#include "tileset.h"
+#include <Windows.h>
+#include <GL/gl.h>
+#include <stdio.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define GROUND_UPLOADS_PER_FRAME 2 // Textures made per frame, so arrivals never cause a hitch
+
+namespace {
+	enum TileState {tileAbsent, tileQueued, tileLoading, tileReady, tileResident};
+
+	struct StreamTile{
+		int level, x, y;
+		TileState state;
+		unsigned int windowFrame; // Last frame the clipmap wanted it
+		unsigned int lastUsed;    // Last frame it was wanted or drawn
+		int residentBelow;        // Resident tiles under this one in the pyramid
+		GLuint name;
+		std::vector<unsigned char> pixels; // Read but not yet uploaded
+	};
+
+	struct GroundStream{
+		bool open;
+		TileSet tiles;
+		int window;
+		size_t textureBytes; // GPU memory for one tile (RGB, mipmaps included)
+		std::vector<StreamTile> tile;
+		std::vector<int> wanted;
+		unsigned int frame;
+
+		std::mutex lock;
+		std::condition_variable queued;
+		std::deque<int> queue; // Waiting to be read, coarsest first
+		std::deque<int> ready; // Read, waiting to be uploaded
+		std::thread loader;
+		GroundStreamStats stats;
+
+		GroundStream() : open(false), window(0), textureBytes(0), frame(1) {}
+	};
+
+	/* Never destroyed, so the loader thread can still be waiting when the
+	   program exits */
+	GroundStream& stream = *new GroundStream;
+
+	/* Called with the lock held */
+	bool inWindow(const StreamTile& tile)
+	{
+		return tile.windowFrame == stream.frame;
+	}
+
+	void addResidentBytes(size_t bytes)
+	{
+		stream.stats.resident_bytes += bytes;
+		if(stream.stats.resident_bytes > stream.stats.peak_bytes)
+			stream.stats.peak_bytes = stream.stats.resident_bytes;
+	}
+
+	/* Counts a tile arriving or leaving in every tile above it */
+	void markAncestors(const StreamTile& tile, int change)
+	{
+		int x = tile.x, y = tile.y;
+		for(int level = tile.level + 1; level < stream.tiles.levels; level++)
+		{
+			x /= 2;
+			y /= 2;
+			stream.tile[getTileIndex(stream.tiles, level, x, y)].residentBelow += change;
+		}
+	}
+
+	void loaderLoop(void)
+	{
+		std::unique_lock<std::mutex> held(stream.lock);
+		for(;;)
+		{
+			while(stream.queue.empty())
+				stream.queued.wait(held);
+			int index = stream.queue.front();
+			stream.queue.pop_front();
+
+			/* Flown past before its turn came */
+			StreamTile& tile = stream.tile[index];
+			if(!inWindow(tile))
+			{
+				tile.state = tileAbsent;
+				stream.stats.resident_bytes -= stream.tiles.tileBytes;
+				stream.stats.cancelled++;
+				continue;
+			}
+
+			/* Copying out of the mapping is what actually reads the file */
+			tile.state = tileLoading;
+			held.unlock();
+			const unsigned char* source = getTilePixels(stream.tiles, index);
+			std::vector<unsigned char> pixels(source, source + stream.tiles.tileBytes);
+			held.lock();
+
+			tile.pixels.swap(pixels);
+			tile.state = tileReady;
+			stream.ready.push_back(index);
+		}
+	}
+
+	void uploadTile(StreamTile& tile, const std::vector<unsigned char>& pixels)
+	{
+		glGenTextures(1, &tile.name);
+		glBindTexture(GL_TEXTURE_2D, tile.name);
+
+		/* The border takes care of filtering across the joins */
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+		const TileSet& tiles = stream.tiles;
+		for(int i = 0; i < tiles.mipCount; i++)
+			glTexImage2D(GL_TEXTURE_2D, i, 3, tiles.mips[i].width, tiles.mips[i].height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[tiles.mips[i].offset]);
+	}
+
+	/* Drops the least recently used resident tile outside the clipmap. Called
+	   with the lock held. Returns false if there is none */
+	bool evictTile(void)
+	{
+		StreamTile* oldest = NULL;
+		for(size_t i = 0; i < stream.tile.size(); i++)
+		{
+			StreamTile& tile = stream.tile[i];
+			if(tile.state == tileResident && !inWindow(tile) && (oldest == NULL || tile.lastUsed < oldest->lastUsed))
+				oldest = &tile;
+		}
+		if(oldest == NULL)
+			return false;
+
+		glDeleteTextures(1, &oldest->name);
+		oldest->name = 0;
+		oldest->state = tileAbsent;
+		markAncestors(*oldest, -1);
+		stream.stats.resident_tiles--;
+		stream.stats.resident_bytes -= stream.textureBytes;
+		stream.stats.evictions++;
+		return true;
+	}
+
+	/* Queues a tile for the loader if the budget allows, making room if need
+	   be. Called with the lock held */
+	bool requestTile(int index)
+	{
+		while(stream.stats.resident_bytes + stream.tiles.tileBytes > stream.stats.budget_bytes)
+			if(!evictTile())
+				return false;
+
+		stream.tile[index].state = tileQueued;
+		addResidentBytes(stream.tiles.tileBytes);
+		stream.queue.push_back(index);
+		stream.queued.notify_one();
+		return true;
+	}
+
+	/* Draws the part of the ground under a tile, using the finest resident
+	   tiles available and falling back to source (the closest resident tile
+	   above) where there are none. Called with the lock held */
+	void drawTile(int level, int x, int y, int source, const float* corners, GLuint& bound)
+	{
+		StreamTile& tile = stream.tile[getTileIndex(stream.tiles, level, x, y)];
+		if(tile.state == tileResident)
+		{
+			source = (int)(&tile - &stream.tile[0]);
+			tile.lastUsed = stream.frame;
+		}
+
+		if(level > 0 && tile.residentBelow > 0)
+		{
+			for(int i = 0; i < 4; i++)
+				drawTile(level - 1, x*2 + (i & 1), y*2 + (i >> 1), source, corners, bound);
+			return;
+		}
+		if(source < 0)
+			return;
+
+		/* This tile's square of the ground, and where it lies in the source's
+		   texture (inside the border) */
+		const StreamTile& from = stream.tile[source];
+		float across = (float)getTilesAcross(stream.tiles, level);
+		float fromAcross = (float)getTilesAcross(stream.tiles, from.level);
+		float border = (float)TILESET_BORDER/stream.tiles.tileSize;
+		float scale = 1.0f - 2.0f*border;
+
+		GLfloat vertices[12], texCoords[8];
+		for(int c = 0; c < 4; c++)
+		{
+			float u = (x + ((c == 1 || c == 2) ? 1 : 0))/across;
+			float v = (y + (c >= 2 ? 1 : 0))/across;
+			for(int axis = 0; axis < 3; axis++)
+				vertices[c*3 + axis] = corners[axis] + u*(corners[3 + axis] - corners[axis]) + v*(corners[9 + axis] - corners[axis]);
+			texCoords[c*2] = border + (u*fromAcross - from.x)*scale;
+			texCoords[c*2 + 1] = border + (v*fromAcross - from.y)*scale;
+		}
+
+		if(from.name != bound)
+		{
+			glBindTexture(GL_TEXTURE_2D, from.name);
+			bound = from.name;
+		}
+		glVertexPointer(3, GL_FLOAT, 0, vertices);
+		glTexCoordPointer(2, GL_FLOAT, 0, texCoords);
+		glDrawArrays(GL_QUADS, 0, 4);
+	}
+}
+
+bool openGroundStream(const char* filename, size_t budgetBytes, int window)
+{
+	if(stream.open || !openTileSet(stream.tiles, filename))
+		return false;
+
+	stream.window = window;
+	stream.textureBytes = stream.tiles.tileBytes/TILESET_CHANNELS*3;
+	stream.tile.resize(getTileCount(stream.tiles));
+	for(int level = 0; level < stream.tiles.levels; level++)
+	{
+		int across = getTilesAcross(stream.tiles, level);
+		for(int y = 0; y < across; y++)
+		{
+			for(int x = 0; x < across; x++)
+			{
+				StreamTile& tile = stream.tile[getTileIndex(stream.tiles, level, x, y)];
+				tile.level = level;
+				tile.x = x;
+				tile.y = y;
+				tile.state = tileAbsent;
+				tile.windowFrame = tile.lastUsed = 0;
+				tile.residentBelow = 0;
+				tile.name = 0;
+			}
+		}
+	}
+
+	stream.stats.hits = stream.stats.misses = stream.stats.loads = 0;
+	stream.stats.cancelled = stream.stats.evictions = 0;
+	stream.stats.resident_tiles = 0;
+	stream.stats.resident_bytes = stream.stats.peak_bytes = 0;
+	stream.stats.budget_bytes = budgetBytes;
+
+	stream.loader = std::thread(loaderLoop);
+	stream.open = true;
+	return true;
+}
+
+bool groundStreamOpen(void)
+{
+	return stream.open;
+}
+
+void updateGroundStream(float u, float v)
+{
+	if(!stream.open)
+		return;
+
+	/* Turn a few arrivals into textures, outside the lock */
+	for(int n = 0; n < GROUND_UPLOADS_PER_FRAME; n++)
+	{
+		std::vector<unsigned char> pixels;
+		StreamTile* tile;
+		{
+			std::lock_guard<std::mutex> guard(stream.lock);
+			if(stream.ready.empty())
+				break;
+			tile = &stream.tile[stream.ready.front()];
+			stream.ready.pop_front();
+			tile->pixels.swap(pixels);
+		}
+
+		uploadTile(*tile, pixels);
+
+		std::lock_guard<std::mutex> guard(stream.lock);
+		tile->state = tileResident;
+		markAncestors(*tile, 1);
+		stream.stats.loads++;
+		stream.stats.resident_tiles++;
+		stream.stats.resident_bytes -= stream.tiles.tileBytes;
+		addResidentBytes(stream.textureBytes);
+	}
+
+	std::lock_guard<std::mutex> guard(stream.lock);
+	stream.frame++;
+
+	/* The clipmap: the same number of tiles around (u, v) on every level,
+	   coarsest first so there's always something to draw */
+	stream.wanted.clear();
+	for(int level = stream.tiles.levels - 1; level >= 0; level--)
+	{
+		int across = getTilesAcross(stream.tiles, level);
+		int centreX = (int)(u*across), centreY = (int)(v*across);
+		centreX = centreX < 0 ? 0 : (centreX >= across ? across - 1 : centreX);
+		centreY = centreY < 0 ? 0 : (centreY >= across ? across - 1 : centreY);
+		for(int y = centreY - stream.window; y <= centreY + stream.window; y++)
+			for(int x = centreX - stream.window; x <= centreX + stream.window; x++)
+				if(x >= 0 && y >= 0 && x < across && y < across)
+					stream.wanted.push_back(getTileIndex(stream.tiles, level, x, y));
+	}
+
+	for(size_t i = 0; i < stream.wanted.size(); i++)
+	{
+		StreamTile& tile = stream.tile[stream.wanted[i]];
+		if(tile.windowFrame + 1 != stream.frame)
+		{
+			if(tile.state == tileAbsent)
+				stream.stats.misses++;
+			else
+				stream.stats.hits++;
+		}
+		tile.windowFrame = tile.lastUsed = stream.frame;
+	}
+
+	/* Only once every wanted tile is marked, so none of them gets evicted */
+	for(size_t i = 0; i < stream.wanted.size(); i++)
+		if(stream.tile[stream.wanted[i]].state == tileAbsent && !requestTile(stream.wanted[i]))
+			break;
+}
+
+void drawGroundStream(const float* corners)
+{
+	if(!stream.open)
+		return;
+
+	std::lock_guard<std::mutex> guard(stream.lock);
+	GLuint bound = 0;
+	drawTile(stream.tiles.levels - 1, 0, 0, -1, corners, bound);
+}
+
+GroundStreamStats getGroundStreamStats(void)
+{
+	std::lock_guard<std::mutex> guard(stream.lock);
+	return stream.stats;
+}
+
+void printGroundStreamStats(void)
+{
+	if(!stream.open)
+		return;
+
+	GroundStreamStats stats = getGroundStreamStats();
+	unsigned int requests = stats.hits + stats.misses;
+	printf("Ground tiles: %.1f%% hit rate (%u hits, %u misses), %u loaded, %u cancelled, %u evicted\n",
+		requests ? 100.0*stats.hits/requests : 0.0, stats.hits, stats.misses, stats.loads, stats.cancelled, stats.evictions);
+	printf("Ground tiles: %d resident in %.1f KB, peak %.1f KB of a %.1f KB budget\n",
+		stats.resident_tiles, stats.resident_bytes/1024.0, stats.peak_bytes/1024.0, stats.budget_bytes/1024.0);
+}
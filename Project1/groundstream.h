@@ -0,0 +1,56 @@
+/*
+ * groundstream.h
+ *
+ * Streams the floor from a tile set (see tileset.h) too big to keep resident.
+ * Around the plane a clipmap is kept: on every level of the pyramid the tiles
+ * within a few tiles of it are wanted, so detail falls away with distance. A
+ * background thread reads wanted tiles from the mapped file, the main thread
+ * turns them into textures a few per frame, and the least recently drawn tiles
+ * outside the clipmap are dropped to stay within a fixed memory budget.
+ *
+ * Until a tile arrives its area is drawn from the nearest coarser tile that is
+ * resident, so the floor is never missing, only blurrier for a moment.
+ *
+ * Everything except the loader thread runs on the thread that owns the GL
+ * context.
+ */
+
+#ifndef GROUNDSTREAM_H_
+#define GROUNDSTREAM_H_
+
+#include <stddef.h>
+
+struct GroundStreamStats{
+	unsigned int hits;      // Tiles entering the clipmap that were still resident
+	unsigned int misses;    // Tiles entering the clipmap that had to be read
+	unsigned int loads;     // Tiles read and uploaded
+	unsigned int cancelled; // Reads dropped because the tile left the clipmap first
+	unsigned int evictions; // Resident tiles dropped to stay in budget
+	int resident_tiles;
+	size_t resident_bytes;  // Textures plus tiles read but not yet uploaded
+	size_t peak_bytes;
+	size_t budget_bytes;
+};
+
+//Maps the tile set and starts the loader thread. window is how many tiles
+//either side of the plane are wanted on each level. Returns false if the file
+//is missing or damaged
+bool openGroundStream(const char* filename, size_t budgetBytes, int window);
+
+bool groundStreamOpen(void);
+
+//Moves the clipmap to (u, v) on the ground (0 to 1 across each side), queues
+//the tiles it now wants and uploads tiles that have finished loading. Call
+//once a frame
+void updateGroundStream(float u, float v);
+
+//Draws the ground over the quad with the given corners (x, y, z each), the
+//image's u axis running from the first corner to the second and v from the
+//first to the fourth. Expects GL_TEXTURE_2D and the vertex and texture
+//co-ordinate arrays to be enabled
+void drawGroundStream(const float* corners);
+
+GroundStreamStats getGroundStreamStats(void);
+void printGroundStreamStats(void);
+
+#endif /* GROUNDSTREAM_H_ */
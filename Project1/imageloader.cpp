@@ -22,14 +22,27 @@
 
 
 
-#include <assert.h>
-#include <fstream>
+#include <stdio.h>
+#include <string.h>
 
 #include "imageloader.h"
+#include "platform.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#include <tmmintrin.h>
+#define IMAGE_SSSE3
+/* GCC only emits SSSE3 instructions in functions marked for it; the pshufb
+   paths are only called once cpuHasSSSE3 says they're safe */
+#if defined(__GNUC__) && !defined(__SSSE3__)
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#else
+#define TARGET_SSSE3
+#endif
+#endif
 
 using namespace std;
 
-Image::Image(char* ps, int w, int h) : pixels(ps), width(w), height(h) {
+Image::Image(char* ps, int w, int h, int c) : pixels(ps), width(w), height(h), channels(c) {
 	
 }
 
@@ -51,162 +64,137 @@ namespace {
 		return (short)(((unsigned char)bytes[1] << 8) |
 					   (unsigned char)bytes[0]);
 	}
-	
-	//Reads the next four bytes as an integer, using little-endian form
-	int readInt(ifstream &input) {
-		char buffer[4];
-		input.read(buffer, 4);
-		return toInt(buffer);
+
+	//Swaps one row of BGR or BGRA pixels (inBytes per pixel) into RGB or RGBA
+	//(outBytes per pixel), making alpha opaque when the source has none
+	void swizzleRowScalar(const unsigned char* in, unsigned char* out, int width, int inBytes, int outBytes) {
+		for(int x = 0; x < width; x++) {
+			out[0] = in[2];
+			out[1] = in[1];
+			out[2] = in[0];
+			if(outBytes == 4)
+				out[3] = inBytes == 4 ? in[3] : 255;
+			in += inBytes;
+			out += outBytes;
+		}
 	}
-	
-	//Reads the next two bytes as a short, using little-endian form
-	short readShort(ifstream &input) {
-		char buffer[2];
-		input.read(buffer, 2);
-		return toShort(buffer);
+
+#ifdef IMAGE_SSSE3
+	//The same with one pshufb per four pixels. A 16 byte load covers at least
+	//four source pixels, and a 16 byte store at least four destination pixels,
+	//so the loop stops while both are still inside the row; any bytes stored
+	//past the four pixels are rewritten by the next step. The rest of the row
+	//is done by swizzleRowScalar
+	TARGET_SSSE3 void swizzleRowSSSE3(const unsigned char* in, unsigned char* out, int width, int inBytes, int outBytes) {
+		__m128i shuffle, alpha;
+		if(inBytes == 3 && outBytes == 3) {
+			shuffle = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, -1, -1, -1, -1);
+			alpha = _mm_setzero_si128();
+		} else if(inBytes == 3) {
+			shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+			alpha = _mm_set1_epi32((int)0xff000000);
+		} else if(outBytes == 3) {
+			shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+			alpha = _mm_setzero_si128();
+		} else {
+			shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+			alpha = _mm_setzero_si128();
+		}
+
+		int x = 0;
+		for(; x*inBytes + 16 <= width*inBytes && x*outBytes + 16 <= width*outBytes; x += 4) {
+			__m128i pixels = _mm_loadu_si128((const __m128i*)(in + x*inBytes));
+			_mm_storeu_si128((__m128i*)(out + x*outBytes), _mm_or_si128(_mm_shuffle_epi8(pixels, shuffle), alpha));
+		}
+		swizzleRowScalar(in + x*inBytes, out + x*outBytes, width - x, inBytes, outBytes);
 	}
-	
-	//Just like auto_ptr, but for arrays
-	template<class T>
-	class auto_array {
-		private:
-			T* array;
-			mutable bool isReleased;
-		public:
-			explicit auto_array(T* array_ = NULL) :
-				array(array_), isReleased(false) {
-			}
-			
-			auto_array(const auto_array<T> &aarray) {
-				array = aarray.array;
-				isReleased = aarray.isReleased;
-				aarray.isReleased = true;
-			}
-			
-			~auto_array() {
-				if (!isReleased && array != NULL) {
-					delete[] array;
-				}
-			}
-			
-			T* get() const {
-				return array;
-			}
-			
-			T &operator*() const {
-				return *array;
-			}
-			
-			void operator=(const auto_array<T> &aarray) {
-				if (!isReleased && array != NULL) {
-					delete[] array;
-				}
-				array = aarray.array;
-				isReleased = aarray.isReleased;
-				aarray.isReleased = true;
-			}
-			
-			T* operator->() const {
-				return array;
-			}
-			
-			T* release() {
-				isReleased = true;
-				return array;
-			}
-			
-			void reset(T* array_ = NULL) {
-				if (!isReleased && array != NULL) {
-					delete[] array;
-				}
-				array = array_;
-			}
-			
-			T* operator+(int i) {
-				return array + i;
-			}
-			
-			T &operator[](int i) {
-				return array[i];
-			}
-	};
+#endif
 }
 
-Image* loadBMP(const char* filename) {
-	ifstream input;
-	input.open(filename, ifstream::binary);
-	assert(!input.fail() || !"Could not find file");
-	char buffer[2];
-	input.read(buffer, 2);
-	assert(buffer[0] == 'B' && buffer[1] == 'M' || !"Not a bitmap file");
-	input.ignore(8);
-	int dataOffset = readInt(input);
+Image* loadBMP(const char* filename, bool rgba) {
+	MappedFile file;
+	if(!openMappedFile(file, filename)) {
+		printf("Could not open image %s\n", filename);
+		return NULL;
+	}
+	const char* data = file.data;
+
+	if(file.size < 26 || data[0] != 'B' || data[1] != 'M') {
+		printf("Image %s is not a bitmap file\n", filename);
+		closeMappedFile(file);
+		return NULL;
+	}
+	int dataOffset = toInt(data + 10);
 	
 	//Read the header
-	int headerSize = readInt(input);
-	int width;
-	int height;
+	int headerSize = toInt(data + 14);
+	int width = 0;
+	int height = 0;
+	int bitsPerPixel = 0;
+	int compression = 0;
 	switch(headerSize) {
-		case 40:
-			//V3
-			width = readInt(input);
-			height = readInt(input);
-			input.ignore(2);
-			assert(readShort(input) == 24 || !"Image is not 24 bits per pixel");
-			assert(readShort(input) == 0 || !"Image is compressed");
+		case 40:  //V3
+		case 108: //Windows V4
+		case 124: //Windows V5, both of which start with the V3 fields
+			if(file.size >= 14 + 40) {
+				width = toInt(data + 18);
+				height = toInt(data + 22);
+				bitsPerPixel = toShort(data + 28);
+				compression = toInt(data + 30);
+			}
 			break;
 		case 12:
 			//OS/2 V1
-			width = readShort(input);
-			height = readShort(input);
-			input.ignore(2);
-			assert(readShort(input) == 24 || !"Image is not 24 bits per pixel");
-			break;
-		case 64:
-			//OS/2 V2
-			assert(!"Can't load OS/2 V2 bitmaps");
-			break;
-		case 108:
-			//Windows V4
-			assert(!"Can't load Windows V4 bitmaps");
-			break;
-		case 124:
-			//Windows V5
-			assert(!"Can't load Windows V5 bitmaps");
+			width = toShort(data + 18);
+			height = toShort(data + 20);
+			bitsPerPixel = toShort(data + 24);
 			break;
 		default:
-			assert(!"Unknown bitmap format");
+			printf("Image %s has an unsupported bitmap header (%d bytes)\n", filename, headerSize);
+			closeMappedFile(file);
+			return NULL;
 	}
-	
-	//Read the data
-	int bytesPerRow = ((width * 3 + 3) / 4) * 4 - (width * 3 % 4);
-	int size = bytesPerRow * height;
-	auto_array<char> pixels(new char[size]);
-	input.seekg(dataOffset, ios_base::beg);
-	input.read(pixels.get(), size);
-	
-	//Get the data into the right format
-	auto_array<char> pixels2(new char[width * height * 3]);
+
+	if((bitsPerPixel != 24 && bitsPerPixel != 32) || compression != 0 || width <= 0 || height == 0) {
+		printf("Image %s is not an uncompressed 24 or 32 bit bitmap\n", filename);
+		closeMappedFile(file);
+		return NULL;
+	}
+
+	//Rows are stored bottom up (as OpenGL wants them) unless the height is negative
+	bool topDown = height < 0;
+	if(topDown)
+		height = -height;
+
+	//Each row is padded to a multiple of four bytes
+	int inBytes = bitsPerPixel/8;
+	size_t bytesPerRow = ((size_t)width*inBytes + 3) & ~(size_t)3;
+	if(dataOffset < 0 || (size_t)dataOffset > file.size || (file.size - dataOffset)/bytesPerRow < (size_t)height) {
+		printf("Image %s is truncated\n", filename);
+		closeMappedFile(file);
+		return NULL;
+	}
+
+	//Swap BGR(A) to RGB(A) straight out of the mapping into the one image allocation
+	int outBytes = rgba ? 4 : 3;
+	char* pixels = new char[(size_t)width*height*outBytes];
+	const unsigned char* rows = (const unsigned char*)data + dataOffset;
+#ifdef IMAGE_SSSE3
+	bool ssse3 = cpuHasSSSE3();
+#endif
 	for(int y = 0; y < height; y++) {
-		for(int x = 0; x < width; x++) {
-			for(int c = 0; c < 3; c++) {
-				pixels2[3 * (width * y + x) + c] =
-					pixels[bytesPerRow * y + 3 * x + (2 - c)];
-			}
+		const unsigned char* in = rows + bytesPerRow*(topDown ? height - 1 - y : y);
+		unsigned char* out = (unsigned char*)pixels + (size_t)width*outBytes*y;
+#ifdef IMAGE_SSSE3
+		if(ssse3) {
+			swizzleRowSSSE3(in, out, width, inBytes, outBytes);
+			continue;
 		}
+#endif
+		swizzleRowScalar(in, out, width, inBytes, outBytes);
 	}
-	
-	printf("Loaded image %s\n", filename);
 
-	input.close();
-	return new Image(pixels2.release(), width, height);
+	closeMappedFile(file);
+	printf("Loaded image %s\n", filename);
+	return new Image(pixels, width, height, outBytes);
 }
-
-
-
-
-
-
-
-
-
@@ -26,10 +26,11 @@
 //Represents an image
 class Image {
 	public:
-		Image(char* ps, int w, int h);
+		Image(char* ps, int w, int h, int c = 3);
 		~Image();
 		
-		/* An array of the form (R1, G1, B1, R2, G2, B2, ...) indicating the
+		/* An array of the form (R1, G1, B1, R2, G2, B2, ...), or with an A
+		 * after each B when channels is 4, indicating the
 		 * color of each pixel in image.  Color components range from 0 to 255.
 		 * The array starts the bottom-left pixel, then moves right to the end
 		 * of the row, then moves up to the next column, and so on.  This is the
@@ -38,10 +39,13 @@ class Image {
 		char* pixels;
 		int width;
 		int height;
+		int channels; //3 for RGB or 4 for RGBA
 };
 
-//Reads a bitmap image from file.
-Image* loadBMP(const char* filename);
+//Reads an uncompressed 24 or 32 bit bitmap image from file, or returns NULL if
+//it can't. With rgba the pixels are RGBA (opaque unless the file has alpha), so
+//every row is a multiple of four bytes, which OpenGL uploads without repacking.
+Image* loadBMP(const char* filename, bool rgba = false);
 
 
 
@@ -0,0 +1,222 @@
+/*
+ * jobs.cpp
+ */
+
+#include "jobs.h"
+#include "platform.h"
+#include <stdio.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#define JOB_REPORT_LENGTH 64 // Finished jobs remembered for printJobReport
+
+namespace {
+	struct Job{
+		std::string name;
+		std::function<void(void)> work;
+		int waitingOn;                // Dependencies not finished yet
+		std::vector<JobId> dependents;
+		int thread;                   // 0 for the main thread, workers count from 1
+		double queued, started;
+	};
+
+	//What printJobReport shows of a job once it has been freed
+	struct FinishedJob{
+		std::string name;
+		int thread;
+		double queued, started, finished;
+	};
+
+	struct JobPool{
+		std::mutex lock;
+		std::condition_variable jobReady;
+		std::condition_variable jobDone;
+		std::unordered_map<JobId, Job*> jobs; // Queued or running; any other id below nextId is done
+		JobId nextId;
+		std::deque<JobId> ready;
+		std::deque<FinishedJob> finished;     // The last JOB_REPORT_LENGTH to finish, oldest first
+		std::vector<std::thread> workers;
+		bool stopping;
+		double startTime;
+
+		JobPool() : nextId(0), stopping(false), startTime(0) {}
+	};
+
+	/* Never destroyed, so workers still waiting for jobs don't abort the
+	   program when it exits */
+	JobPool& pool = *new JobPool;
+
+	/* Called with the lock held; returns with it held. The job is freed once
+	   it's done, keeping only its times for the report */
+	void runJob(std::unique_lock<std::mutex>& held, JobId id, int thread)
+	{
+		Job* job = pool.jobs[id];
+		job->thread = thread;
+		job->started = getSeconds();
+
+		held.unlock();
+		job->work();
+		held.lock();
+
+		FinishedJob record;
+		record.name.swap(job->name);
+		record.thread = thread;
+		record.queued = job->queued;
+		record.started = job->started;
+		record.finished = getSeconds();
+		pool.finished.push_back(record);
+		if(pool.finished.size() > JOB_REPORT_LENGTH)
+			pool.finished.pop_front();
+
+		for(size_t i = 0; i < job->dependents.size(); i++)
+		{
+			if(--pool.jobs[job->dependents[i]]->waitingOn == 0)
+			{
+				pool.ready.push_back(job->dependents[i]);
+				pool.jobReady.notify_one();
+			}
+		}
+		pool.jobs.erase(id);
+		delete job;
+		pool.jobDone.notify_all();
+	}
+
+	bool isDone(JobId id)
+	{
+		return pool.jobs.find(id) == pool.jobs.end();
+	}
+
+	void workerLoop(int thread)
+	{
+		std::unique_lock<std::mutex> held(pool.lock);
+		for(;;)
+		{
+			while(pool.ready.empty() && !pool.stopping)
+				pool.jobReady.wait(held);
+			if(pool.ready.empty())
+				return;
+
+			JobId id = pool.ready.front();
+			pool.ready.pop_front();
+			runJob(held, id, thread);
+		}
+	}
+}
+
+void startJobPool(int threads)
+{
+	pool.startTime = getSeconds();
+	pool.stopping = false;
+	for(int i = 0; i < threads; i++)
+		pool.workers.push_back(std::thread(workerLoop, i + 1));
+}
+
+void stopJobPool(void)
+{
+	waitForAllJobs();
+	{
+		std::lock_guard<std::mutex> guard(pool.lock);
+		pool.stopping = true;
+	}
+	pool.jobReady.notify_all();
+	for(size_t i = 0; i < pool.workers.size(); i++)
+		pool.workers[i].join();
+	pool.workers.clear();
+}
+
+JobId submitJob(const char* name, const std::function<void(void)>& work, JobId dependency)
+{
+	std::vector<JobId> dependencies;
+	if(dependency != NO_JOB)
+		dependencies.push_back(dependency);
+	return submitJob(name, work, dependencies);
+}
+
+JobId submitJob(const char* name, const std::function<void(void)>& work, const std::vector<JobId>& dependencies)
+{
+	std::unique_lock<std::mutex> held(pool.lock);
+
+	JobId id = pool.nextId++;
+	Job* job = new Job;
+	job->name = name;
+	job->work = work;
+	job->waitingOn = 0;
+	job->thread = 0;
+	job->queued = getSeconds();
+	job->started = 0;
+	pool.jobs[id] = job;
+
+	for(size_t i = 0; i < dependencies.size(); i++)
+	{
+		if(!isDone(dependencies[i]))
+		{
+			pool.jobs[dependencies[i]]->dependents.push_back(id);
+			job->waitingOn++;
+		}
+	}
+
+	if(job->waitingOn == 0)
+	{
+		/* Without workers nothing else would ever run it */
+		if(pool.workers.empty())
+		{
+			runJob(held, id, 0);
+			return id;
+		}
+		pool.ready.push_back(id);
+		pool.jobReady.notify_one();
+	}
+	return id;
+}
+
+void waitForJob(JobId id)
+{
+	std::unique_lock<std::mutex> held(pool.lock);
+	while(!isDone(id))
+	{
+		/* Help rather than sit idle */
+		if(!pool.ready.empty())
+		{
+			JobId next = pool.ready.front();
+			pool.ready.pop_front();
+			runJob(held, next, 0);
+		} else {
+			pool.jobDone.wait(held);
+		}
+	}
+}
+
+void waitForAllJobs(void)
+{
+	std::unique_lock<std::mutex> held(pool.lock);
+	while(!pool.jobs.empty())
+	{
+		if(!pool.ready.empty())
+		{
+			JobId next = pool.ready.front();
+			pool.ready.pop_front();
+			runJob(held, next, 0);
+		} else {
+			pool.jobDone.wait(held);
+		}
+	}
+}
+
+void printJobReport(void)
+{
+	std::lock_guard<std::mutex> guard(pool.lock);
+	printf("Jobs on %d worker threads (ms since start: queued, started, finished):\n", (int)pool.workers.size());
+	for(size_t i = 0; i < pool.finished.size(); i++)
+	{
+		const FinishedJob& job = pool.finished[i];
+		printf("  %-28s %8.1f %8.1f %8.1f  (%.1f ms on %s %d)\n", job.name.c_str(),
+			(job.queued - pool.startTime)*1000.0, (job.started - pool.startTime)*1000.0, (job.finished - pool.startTime)*1000.0,
+			(job.finished - job.started)*1000.0, job.thread == 0 ? "main" : "worker", job.thread);
+	}
+	for(std::unordered_map<JobId, Job*>::const_iterator job = pool.jobs.begin(); job != pool.jobs.end(); job++)
+		printf("  %-28s still running\n", job->second->name.c_str());
+}
@@ -0,0 +1,39 @@
+/*
+ * jobs.h
+ *
+ * A pool of worker threads running a graph of jobs, each of which starts once
+ * the jobs it depends on have finished. Startup uses it to load assets while
+ * GLUT creates the window. Jobs must not touch OpenGL, which belongs to the
+ * main thread.
+ */
+
+#ifndef JOBS_H_
+#define JOBS_H_
+
+#include <functional>
+#include <vector>
+
+typedef int JobId;
+#define NO_JOB -1
+
+//Starts the workers. With no threads, submitJob runs each job straight away on
+//the calling thread, which gives the old sequential behaviour
+void startJobPool(int threads);
+
+//Waits for every job and stops the workers
+void stopJobPool(void);
+
+//Queues work to run once dependency (or every job in dependencies) is done
+JobId submitJob(const char* name, const std::function<void(void)>& work, JobId dependency = NO_JOB);
+JobId submitJob(const char* name, const std::function<void(void)>& work, const std::vector<JobId>& dependencies);
+
+//Waits for a job to finish, running queued jobs on this thread meanwhile
+void waitForJob(JobId job);
+void waitForAllJobs(void);
+
+//Prints when each of the last jobs to finish was queued, started and finished,
+//in ms since startJobPool, then the ones still to finish. Jobs are freed as
+//they finish, so only their times are kept for this
+void printJobReport(void);
+
+#endif /* JOBS_H_ */
@@ -0,0 +1,138 @@
+/*
+ * level.cpp
+ */
+
+#include "level.h"
+#include "arena.h"
+#include "platform.h"
+#include <stdio.h>
+
+namespace {
+	inline bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+	}
+
+	//Returns the next token from p on, leaving p after it. An empty token means
+	//the end of the file
+	inline LevelToken nextToken(const char*& p, const char* end)
+	{
+		while(p < end && isSpace(*p))
+			p++;
+		LevelToken token = {p, 0};
+		while(p < end && !isSpace(*p))
+			p++;
+		token.length = p - token.start;
+		return token;
+	}
+
+	//Reads a whole token as a decimal integer with an optional sign
+	bool parseInt(const char* p, const char* end, int& value)
+	{
+		bool negative = p < end && *p == '-';
+		if(p < end && (*p == '-' || *p == '+'))
+			p++;
+		if(p == end)
+			return false;
+
+		int result = 0;
+		for(; p < end; p++)
+		{
+			if(*p < '0' || *p > '9')
+				return false;
+			result = result*10 + (*p - '0');
+		}
+		value = negative ? -result : result;
+		return true;
+	}
+
+	//Reads the cell token from p on in the same pass that finds its end, since
+	//this runs once per cell. Returns false, with p where the token starts, if
+	//it isn't a movement followed by a height
+	inline bool parseCell(const char*& p, const char* end, LevelCell& cell)
+	{
+		while(p < end && isSpace(*p))
+			p++;
+		const char* start = p;
+		if(end - p < 2 || !isLevelMovement(*p))
+			return false;
+		char movement = *p++;
+
+		int height = 0;
+		const char* digits = p;
+		while(p < end && *p >= '0' && *p <= '9')
+			height = height*10 + (*p++ - '0');
+		if(p == digits || (p < end && !isSpace(*p)))
+		{
+			p = start;
+			return false;
+		}
+		cell.movement = movement;
+		cell.height = (short)height;
+		return true;
+	}
+}
+
+bool readLevelSize(const char* filename, int& rows, int& cols)
+{
+	MappedFile file;
+	if(!openMappedFile(file, filename))
+		return false;
+
+	/* Only the pages holding the first two tokens are touched */
+	const char* p = file.data;
+	const char* end = file.data + file.size;
+	LevelToken rowToken = nextToken(p, end);
+	LevelToken colToken = nextToken(p, end);
+	bool read = parseInt(rowToken.start, rowToken.start + rowToken.length, rows) && parseInt(colToken.start, colToken.start + colToken.length, cols) &&
+		rows >= 0 && cols >= 0;
+	closeMappedFile(file);
+	return read;
+}
+
+bool readLevel(const char* filename, LevelGrid& grid, Arena& arena)
+{
+	MappedFile file;
+	if(!openMappedFile(file, filename))
+	{
+		printf("Could not open level %s\n", filename);
+		return false;
+	}
+
+	const char* p = file.data;
+	const char* end = file.data + file.size;
+	LevelToken rows = nextToken(p, end);
+	LevelToken cols = nextToken(p, end);
+	bool read = parseInt(rows.start, rows.start + rows.length, grid.rows) && parseInt(cols.start, cols.start + cols.length, grid.cols) &&
+		grid.rows >= 0 && grid.cols >= 0;
+	if(!read)
+		printf("Level %s doesn't start with its rows and columns\n", filename);
+
+	if(read)
+	{
+		size_t count = (size_t)grid.rows*grid.cols;
+		grid.cells = arenaAlloc<LevelCell>(arena, count);
+		for(size_t i = 0; i < count; i++)
+		{
+			if(!parseCell(p, end, grid.cells[i]))
+			{
+				LevelToken token = nextToken(p, end);
+				if(token.length == 0)
+					printf("Level %s ends after %u of its %u cells\n", filename, (unsigned int)i, (unsigned int)count);
+				else
+					printf("Level %s has \"%.*s\" in row %d column %d, which isn't a movement and height\n",
+						filename, (int)token.length, token.start, (int)(i/grid.cols), (int)(i%grid.cols));
+				read = false;
+				break;
+			}
+		}
+	}
+
+	closeMappedFile(file);
+	if(!read)
+	{
+		grid.rows = grid.cols = 0;
+		grid.cells = NULL;
+	}
+	return read;
+}
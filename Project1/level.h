@@ -0,0 +1,59 @@
+/*
+ * level.h
+ *
+ * Reads a level file in one pass. The file is mapped into memory and its
+ * tokens are read where they lie (nothing is copied or scanned twice), and the
+ * grid goes into one row-major array holding each cell's ring height and
+ * movement together, allocated from the level's arena.
+ *
+ * A level file is the number of rows and columns followed by one token per
+ * cell: a movement letter (S still, H horizontal, V vertical, C clockwise, A
+ * anticlockwise) and the ring's height, 0 for no ring. For example "S10 H0".
+ */
+
+#ifndef LEVEL_H_
+#define LEVEL_H_
+
+#include <stddef.h>
+
+struct Arena;
+
+//Part of the mapped file between two blanks
+struct LevelToken{
+	const char* start;
+	size_t length;
+};
+
+struct LevelCell{
+	short height; // Of the ring, 0 for no ring
+	char movement; // The letter from the file
+};
+
+struct LevelGrid{
+	int rows;
+	int cols;
+	LevelCell* cells; // rows*cols, row by row, owned by the arena it was read into
+
+	LevelGrid() : rows(0), cols(0), cells(NULL) {}
+
+	const LevelCell& at(int row, int col) const
+	{
+		return cells[(size_t)row*cols + col];
+	}
+};
+
+//Whether c is one of the movement letters above
+inline bool isLevelMovement(char c)
+{
+	return c == 'S' || c == 'H' || c == 'V' || c == 'C' || c == 'A';
+}
+
+//Parses filename into grid, taking the cells from arena. Returns false,
+//saying why, if it can't be read or isn't a whole grid
+bool readLevel(const char* filename, LevelGrid& grid, Arena& arena);
+
+//Reads only the rows and columns at the start of filename, for listing levels
+//without parsing them. Returns false if it can't be read or doesn't start with them
+bool readLevelSize(const char* filename, int& rows, int& cols);
+
+#endif /* LEVEL_H_ */
@@ -0,0 +1,52 @@
+/*
+ * levelc.cpp
+ *
+ * Offline level compiler: turns a text level (see level.h) into the level
+ * pack (see levelpack.h) the game maps instead of parsing.
+ *
+ *   levelc level0.txt level0.lvl [chunk rows]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "arena.h"
+#include "level.h"
+#include "levelpack.h"
+#include "platform.h"
+
+int main(int argc, char **argv)
+{
+	if(argc < 3 || argc > 4)
+	{
+		fputs("Usage: levelc level.txt output.lvl [chunk rows]\n", stderr);
+		return EXIT_FAILURE;
+	}
+	int chunkRows = argc == 4 ? atoi(argv[3]) : LEVELPACK_CHUNK_ROWS;
+
+	double startTime = getSeconds();
+	Arena arena;
+	LevelGrid grid;
+	if(!readLevel(argv[1], grid, arena))
+	{
+		fprintf(stderr, "Error, could not read %s.\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+	double parseTime = getSeconds() - startTime;
+
+	if(!writeLevelPack(grid, chunkRows, argv[2]))
+		return EXIT_FAILURE;
+
+	startTime = getSeconds();
+	LevelPack pack;
+	if(!openLevelPack(pack, argv[2]))
+	{
+		fprintf(stderr, "Error, could not read back %s.\n", argv[2]);
+		remove(argv[2]);
+		return EXIT_FAILURE;
+	}
+	double openTime = getSeconds() - startTime;
+	printf("%s: %dx%d, %d rings in %d chunks of %d rows, %.1f KB. Parsing the text took %.3f ms, opening the pack %.3f ms\n", argv[2],
+		pack.rows, pack.cols, pack.ringCount, pack.chunkCount, pack.chunkRows, pack.file.size/1024.0, parseTime*1000.0, openTime*1000.0);
+	closeLevelPack(pack);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,254 @@
+/*
+ * levelcache.cpp
+ */
+
+#include "levelcache.h"
+#include "platform.h"
+#include <stdio.h>
+#include <string.h>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#define DEFAULT_LEVEL_CACHE_BUDGET (64*1024*1024)
+
+namespace {
+	struct LevelCache{
+		std::mutex lock;
+		std::condition_variable loaded; // Signalled when a level finishes loading, or fails to
+		std::vector<LevelInfo> levels;
+		std::vector<CachedLevel*> resident;
+		unsigned int clock;     // Counts acquisitions, to find the least recently used
+		LevelCacheStats stats;
+
+		LevelCache() : clock(0)
+		{
+			stats.hits = stats.misses = stats.evictions = 0;
+			stats.resident_levels = 0;
+			stats.resident_bytes = 0;
+			stats.budget_bytes = DEFAULT_LEVEL_CACHE_BUDGET;
+		}
+	};
+
+	/* Never destroyed, so a prefetch still running at exit finds it intact */
+	LevelCache& cache = *new LevelCache;
+
+	//Reads filename's header into info. Returns false if it isn't a level
+	bool readLevelInfo(const std::string& filename, LevelInfo& info)
+	{
+		info.filename = filename;
+		size_t dot = filename.rfind('.');
+		info.packed = dot != std::string::npos && filename.compare(dot, std::string::npos, ".lvl") == 0;
+		if(!info.packed)
+		{
+			info.rings = -1;
+			return readLevelSize(filename.c_str(), info.rows, info.cols);
+		}
+
+		LevelPack pack;
+		if(!openLevelPack(pack, filename.c_str()))
+			return false;
+		info.rows = pack.rows;
+		info.cols = pack.cols;
+		info.rings = pack.ringCount;
+		closeLevelPack(pack);
+		return true;
+	}
+
+	bool fileExists(const std::string& filename)
+	{
+		unsigned long long size, modifiedTime;
+		return getFileInfo(filename.c_str(), size, modifiedTime);
+	}
+
+	//Memory a level holds, counting a pack's whole mapping as if every page had been touched
+	size_t levelBytes(const CachedLevel& level)
+	{
+		return level.arena.reserved + (level.pack.chunks != NULL ? level.pack.file.size : 0);
+	}
+
+	/* Called with the lock held */
+	CachedLevel* findResident(int level)
+	{
+		for(size_t i = 0; i < cache.resident.size(); i++)
+			if(cache.resident[i]->level == level)
+				return cache.resident[i];
+		return NULL;
+	}
+
+	/* Called with the lock held. Drops the least recently used levels not in
+	   use until the rest fit the budget */
+	void evictLevels(void)
+	{
+		for(;;)
+		{
+			size_t idle = 0;
+			int oldest = -1;
+			for(size_t i = 0; i < cache.resident.size(); i++)
+			{
+				CachedLevel* level = cache.resident[i];
+				if(level->users > 0)
+					continue;
+				idle += levelBytes(*level);
+				if(oldest < 0 || level->lastUsed < cache.resident[oldest]->lastUsed)
+					oldest = (int)i;
+			}
+			if(oldest < 0 || idle <= cache.stats.budget_bytes)
+				return;
+
+			CachedLevel* level = cache.resident[oldest];
+			if(level->pack.chunks != NULL)
+				closeLevelPack(level->pack);
+			delete level;
+			cache.resident.erase(cache.resident.begin() + oldest);
+			cache.stats.evictions++;
+		}
+	}
+}
+
+int findLevels(const char* manifest)
+{
+	std::lock_guard<std::mutex> guard(cache.lock);
+	cache.levels.clear();
+
+	FILE* filePtr = fopen(manifest, "r");
+	if(filePtr != NULL)
+	{
+		char line[512];
+		while(fgets(line, sizeof(line), filePtr) != NULL)
+		{
+			/* Blank lines and lines starting with # are skipped */
+			size_t length = strcspn(line, "\r\n");
+			line[length] = '\0';
+			if(length == 0 || line[0] == '#')
+				continue;
+			LevelInfo info;
+			if(readLevelInfo(line, info))
+				cache.levels.push_back(info);
+			else
+				printf("Level %s in %s can't be read, leaving it out\n", line, manifest);
+		}
+		fclose(filePtr);
+		return (int)cache.levels.size();
+	}
+
+	for(int i = 0; ; i++)
+	{
+		char packName[32], textName[32];
+		sprintf(packName, "level%d.lvl", i);
+		sprintf(textName, "level%d.txt", i);
+		bool packFound = fileExists(packName), textFound = fileExists(textName);
+		if(!packFound && !textFound)
+			break;
+
+		/* A pack that can't be read, say from an older levelc, falls back on the text it was made from */
+		LevelInfo info;
+		if(packFound && readLevelInfo(packName, info))
+			cache.levels.push_back(info);
+		else if(textFound && readLevelInfo(textName, info))
+			cache.levels.push_back(info);
+		else
+			printf("Level %s can't be read, leaving it out\n", packFound ? packName : textName);
+	}
+	return (int)cache.levels.size();
+}
+
+int getLevelCount(void)
+{
+	std::lock_guard<std::mutex> guard(cache.lock);
+	return (int)cache.levels.size();
+}
+
+LevelInfo getLevelInfo(int level)
+{
+	std::lock_guard<std::mutex> guard(cache.lock);
+	return cache.levels[level];
+}
+
+void setLevelCacheBudget(size_t bytes)
+{
+	std::lock_guard<std::mutex> guard(cache.lock);
+	cache.stats.budget_bytes = bytes;
+	evictLevels();
+}
+
+CachedLevel* acquireLevel(int level)
+{
+	std::unique_lock<std::mutex> guard(cache.lock);
+
+	/* If another thread is reading it, it may fail to, so look again once it's done */
+	CachedLevel* found;
+	while((found = findResident(level)) != NULL && found->loading)
+		cache.loaded.wait(guard);
+	if(found != NULL)
+	{
+		found->users++;
+		found->lastUsed = ++cache.clock;
+		cache.stats.hits++;
+		return found;
+	}
+
+	/* Listed straight away, marked as loading, so other threads asking for it wait for this one */
+	CachedLevel* loaded = new CachedLevel;
+	loaded->level = level;
+	for(int i = 0; i < LEVEL_RING_LAYOUTS; i++)
+	{
+		loaded->rings[i] = NULL;
+		loaded->heights[i] = 0;
+	}
+	loaded->users = 1;
+	loaded->lastUsed = ++cache.clock;
+	loaded->loading = true;
+	cache.resident.push_back(loaded);
+	LevelInfo info = cache.levels[level];
+
+	guard.unlock();
+	bool read = info.packed ? openLevelPack(loaded->pack, info.filename.c_str()) : readLevel(info.filename.c_str(), loaded->grid, loaded->arena);
+	guard.lock();
+
+	loaded->loading = false;
+	cache.loaded.notify_all();
+	if(!read)
+	{
+		printf("Could not load level %d from %s\n", level, info.filename.c_str());
+		for(size_t i = 0; i < cache.resident.size(); i++)
+			if(cache.resident[i] == loaded)
+				cache.resident.erase(cache.resident.begin() + i);
+		delete loaded;
+		return NULL;
+	}
+	cache.stats.misses++;
+	evictLevels();
+	return loaded;
+}
+
+void releaseLevel(CachedLevel* level)
+{
+	std::lock_guard<std::mutex> guard(cache.lock);
+	level->users--;
+	evictLevels();
+}
+
+LevelCacheStats getLevelCacheStats(void)
+{
+	std::lock_guard<std::mutex> guard(cache.lock);
+	LevelCacheStats stats = cache.stats;
+	stats.resident_levels = 0;
+	stats.resident_bytes = 0;
+	for(size_t i = 0; i < cache.resident.size(); i++)
+	{
+		/* One still loading is being written outside the lock */
+		if(cache.resident[i]->loading)
+			continue;
+		stats.resident_levels++;
+		stats.resident_bytes += levelBytes(*cache.resident[i]);
+	}
+	return stats;
+}
+
+void printLevelCacheStats(void)
+{
+	LevelCacheStats stats = getLevelCacheStats();
+	printf("Level cache: %u hits, %u misses, %u evicted, %d levels resident in %.1f KB of a %.1f KB budget\n",
+		stats.hits, stats.misses, stats.evictions, stats.resident_levels, stats.resident_bytes/1024.0, stats.budget_bytes/1024.0);
+}
@@ -0,0 +1,83 @@
+/*
+ * levelcache.h
+ *
+ * The installed levels and the ones in memory. At startup only the list is
+ * made, from a manifest or by looking for numbered level files, reading just
+ * each file's header. A level's rings are loaded the first time it's played
+ * and kept, along with the ring layouts the game builds from them, until the
+ * levels not in use outgrow a memory budget; then the least recently used are
+ * dropped.
+ *
+ * A level in use is never dropped. The cache can be used from any thread, but
+ * only one thread at a time may use a given level's data. Levels are read
+ * outside the cache's lock, so a thread loading one holds up only threads
+ * asking for the same level.
+ */
+
+#ifndef LEVELCACHE_H_
+#define LEVELCACHE_H_
+
+#include <stddef.h>
+#include <string>
+#include "arena.h"
+#include "level.h"
+#include "levelpack.h"
+#include "rings.h"
+
+#define LEVEL_MANIFEST "levels.txt"
+#define LEVEL_RING_LAYOUTS 3 // Ring layouts kept for each level, one for each difficulty (main.cpp checks it matches)
+
+struct LevelInfo{
+	std::string filename;
+	bool packed;  // Compiled by levelc rather than text
+	int rows;
+	int cols;
+	int rings;    // -1 for a text level, which would have to be read through to count them
+};
+
+struct CachedLevel{
+	int level;
+	Arena arena;                          // Holds the grid and the ring layouts, so dropping the level is one free
+	LevelGrid grid;                       // Empty for a packed level
+	LevelPack pack;                       // No chunks for a text level
+	RingStore* rings[LEVEL_RING_LAYOUTS]; // Built by the game from grid as it needs them, in arena
+	int heights[LEVEL_RING_LAYOUTS];      // Of the highest ring of each layout
+	int users;
+	unsigned int lastUsed;
+	bool loading;                         // Still being read by the thread that first asked for it
+};
+
+struct LevelCacheStats{
+	unsigned int hits;      // Levels asked for that were still in memory
+	unsigned int misses;    // Levels asked for that had to be loaded
+	unsigned int evictions; // Levels dropped to stay in budget
+	int resident_levels;
+	size_t resident_bytes;
+	size_t budget_bytes;
+};
+
+//Lists the levels named in manifest, one file per line, or without it
+//level0, level1 and so on until there's no levelN.lvl or levelN.txt (the .lvl
+//preferred, and the .txt used if the .lvl can't be read). Levels that can't be
+//read are left out, saying so. Reads only each file's header. Returns how many
+//there are
+int findLevels(const char* manifest);
+
+int getLevelCount(void);
+LevelInfo getLevelInfo(int level);
+
+//Sets how many bytes levels not in use may hold before some are dropped
+void setLevelCacheBudget(size_t bytes);
+
+//Returns level's data, loading it if it isn't in memory, and keeps it there
+//until it's released. Returns NULL, saying why, if it can't be read
+CachedLevel* acquireLevel(int level);
+
+void releaseLevel(CachedLevel* level);
+
+//Counts the memory of levels in use too, so mustn't be called while another
+//thread is using a level's data
+LevelCacheStats getLevelCacheStats(void);
+void printLevelCacheStats(void);
+
+#endif /* LEVELCACHE_H_ */
@@ -0,0 +1,205 @@
+/*
+ * levelpack.cpp
+ */
+
+#include "levelpack.h"
+#include "level.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace {
+	const char levelPackMagic[8] = {'L','E','V','E','L','P','K','\0'};
+	const unsigned int levelPackVersion = 1;
+
+	//Header of a level pack file, followed by the chunk index and then every
+	//ring in flying order
+	struct LevelPackHeader{
+		char magic[8];
+		unsigned int version;
+		unsigned int headerSize;
+		unsigned int ringSize;
+		unsigned int rows;
+		unsigned int cols;
+		unsigned int chunkRows;
+		unsigned int chunkCount;
+		unsigned int ringCount;
+		int maxHeight;
+		unsigned int unused;
+	};
+}
+
+bool writeLevelPack(const LevelGrid& grid, int chunkRows, const char* filename)
+{
+	if(chunkRows < 1 || chunkRows > 65536 || grid.cols > 65536)
+	{
+		printf("Level pack chunks must be 1 to 65536 rows, and levels at most 65536 columns wide\n");
+		return false;
+	}
+
+	/* Rings go in flying order, so each chunk's are together */
+	int chunkCount = (grid.rows + chunkRows - 1)/chunkRows;
+	std::vector<LevelPackChunk> chunks(chunkCount);
+	std::vector<LevelPackRing> rings;
+	int maxHeight = 0;
+	for(int chunk = 0; chunk < chunkCount; chunk++)
+	{
+		chunks[chunk].firstRing = (unsigned int)rings.size();
+		int firstRow = chunk*chunkRows;
+		int lastRow = firstRow + chunkRows < grid.rows ? firstRow + chunkRows : grid.rows;
+		for(int row = firstRow; row < lastRow; row++)
+		{
+			for(int col = 0; col < grid.cols; col++)
+			{
+				const LevelCell& cell = grid.at(row, col);
+				if(cell.height == 0)
+					continue;
+				LevelPackRing ring;
+				ring.row = (unsigned short)(row - firstRow);
+				ring.col = (unsigned short)col;
+				ring.height = cell.height;
+				ring.movement = cell.movement;
+				ring.unused = 0;
+				rings.push_back(ring);
+				if(cell.height > maxHeight)
+					maxHeight = cell.height;
+			}
+		}
+		chunks[chunk].ringCount = (unsigned int)rings.size() - chunks[chunk].firstRing;
+	}
+
+	/* openLevelPack won't take a level with nothing to fly through */
+	if(rings.empty())
+	{
+		printf("Level has no rings, so no pack was written to %s\n", filename);
+		return false;
+	}
+
+	FILE* filePtr = fopen(filename, "wb");
+	if(filePtr == NULL)
+	{
+		printf("Could not write level pack %s\n", filename);
+		return false;
+	}
+
+	LevelPackHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, levelPackMagic, sizeof(levelPackMagic));
+	header.version = levelPackVersion;
+	header.headerSize = sizeof(LevelPackHeader);
+	header.ringSize = sizeof(LevelPackRing);
+	header.rows = grid.rows;
+	header.cols = grid.cols;
+	header.chunkRows = chunkRows;
+	header.chunkCount = chunkCount;
+	header.ringCount = (unsigned int)rings.size();
+	header.maxHeight = maxHeight;
+	bool ok = fwrite(&header, sizeof(header), 1, filePtr) == 1;
+	if(ok && chunkCount > 0)
+		ok = fwrite(&chunks[0], sizeof(LevelPackChunk), chunkCount, filePtr) == (size_t)chunkCount;
+	if(ok && !rings.empty())
+		ok = fwrite(&rings[0], sizeof(LevelPackRing), rings.size(), filePtr) == rings.size();
+
+	if(fclose(filePtr) != 0)
+		ok = false;
+	if(!ok)
+	{
+		printf("Could not write level pack %s\n", filename);
+		remove(filename);
+	}
+	return ok;
+}
+
+bool openLevelPack(LevelPack& pack, const char* filename)
+{
+	pack.chunks = NULL;
+	pack.rings = NULL;
+	if(!openMappedFile(pack.file, filename))
+		return false;
+
+	LevelPackHeader header;
+	bool valid = pack.file.size >= sizeof(LevelPackHeader);
+	if(valid)
+	{
+		memcpy(&header, pack.file.data, sizeof(LevelPackHeader));
+		valid = memcmp(header.magic, levelPackMagic, sizeof(levelPackMagic)) == 0
+			&& header.version == levelPackVersion
+			&& header.headerSize == sizeof(LevelPackHeader)
+			&& header.ringSize == sizeof(LevelPackRing)
+			&& header.rows >= 1 && header.rows <= 0x7fffffff && header.cols >= 1 && header.cols <= 65536
+			&& header.chunkRows >= 1 && header.chunkRows <= 65536
+			&& header.chunkCount == (header.rows + header.chunkRows - 1)/header.chunkRows
+			&& header.ringCount >= 1 && header.ringCount <= (unsigned long long)header.rows*header.cols;
+	}
+
+	/* The index and rings have to lie inside the file, and the index has to
+	   cover the rings in order */
+	const char* data = pack.file.data + sizeof(LevelPackHeader);
+	if(valid)
+		valid = (pack.file.size - sizeof(LevelPackHeader))/sizeof(LevelPackChunk) >= header.chunkCount
+			&& (pack.file.size - sizeof(LevelPackHeader) - header.chunkCount*sizeof(LevelPackChunk))/sizeof(LevelPackRing) >= header.ringCount;
+	if(valid)
+	{
+		const LevelPackChunk* chunks = (const LevelPackChunk*)data;
+		unsigned long long next = 0;
+		for(unsigned int i = 0; valid && i < header.chunkCount; i++)
+		{
+			valid = chunks[i].firstRing == next;
+			next += chunks[i].ringCount;
+		}
+		valid = valid && next == header.ringCount;
+	}
+
+	/* Every ring is checked here, once, so nothing read from a chunk while
+	   flying can be out of the level or have a movement the game doesn't know */
+	if(valid)
+	{
+		const LevelPackChunk* chunks = (const LevelPackChunk*)data;
+		const LevelPackRing* rings = (const LevelPackRing*)(data + header.chunkCount*sizeof(LevelPackChunk));
+		for(unsigned int i = 0; valid && i < header.chunkCount; i++)
+		{
+			unsigned int rows = header.rows - i*header.chunkRows < header.chunkRows ? header.rows - i*header.chunkRows : header.chunkRows;
+			const LevelPackRing* ring = rings + chunks[i].firstRing;
+			for(unsigned int j = 0; valid && j < chunks[i].ringCount; j++, ring++)
+			{
+				valid = ring->row < rows && ring->col < header.cols
+					&& ring->height > 0 && ring->height <= header.maxHeight
+					&& isLevelMovement(ring->movement);
+			}
+		}
+	}
+
+	if(!valid)
+	{
+		printf("Level pack %s is damaged or from another version of levelc\n", filename);
+		closeMappedFile(pack.file);
+		return false;
+	}
+	pack.rows = header.rows;
+	pack.cols = header.cols;
+	pack.chunkRows = header.chunkRows;
+	pack.chunkCount = header.chunkCount;
+	pack.ringCount = header.ringCount;
+	pack.maxHeight = header.maxHeight;
+	pack.chunks = (const LevelPackChunk*)data;
+	pack.rings = (const LevelPackRing*)(data + header.chunkCount*sizeof(LevelPackChunk));
+	return true;
+}
+
+void closeLevelPack(LevelPack& pack)
+{
+	closeMappedFile(pack.file);
+	pack.chunks = NULL;
+	pack.rings = NULL;
+}
+
+int getChunkRow(const LevelPack& pack, int chunk)
+{
+	return chunk*pack.chunkRows;
+}
+
+const LevelPackRing* getChunkRings(const LevelPack& pack, int chunk, int& count)
+{
+	count = pack.chunks[chunk].ringCount;
+	return pack.rings + pack.chunks[chunk].firstRing;
+}
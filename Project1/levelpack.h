@@ -0,0 +1,67 @@
+/*
+ * levelpack.h
+ *
+ * A level compiled by levelc into a binary file the game maps instead of
+ * parsing. The rows are cut into chunks of a fixed number of rows; an index
+ * gives each chunk's rings, which are packed one record each in flying order.
+ * Opening a pack checks the header, the index and every ring once, which is a
+ * quick pass over 8 bytes a ring with nothing parsed, so rings can be taken
+ * from any chunk later on without checking them again.
+ */
+
+#ifndef LEVELPACK_H_
+#define LEVELPACK_H_
+
+#include "platform.h"
+
+struct LevelGrid;
+
+#define LEVELPACK_CHUNK_ROWS 256 // Default rows per chunk
+
+//A ring as stored in a pack
+struct LevelPackRing{
+	unsigned short row;  // From the start of its chunk
+	unsigned short col;
+	short height;
+	char movement;       // The letter from the text level
+	char unused;
+};
+
+//Where a chunk's rings are
+struct LevelPackChunk{
+	unsigned int firstRing;
+	unsigned int ringCount;
+};
+
+struct LevelPack{
+	MappedFile file;
+	int rows;
+	int cols;
+	int chunkRows;
+	int chunkCount;
+	int ringCount;
+	int maxHeight;                 // Of the highest ring, as in the text level
+	const LevelPackChunk* chunks;  // chunkCount of them, NULL when no pack is open
+	const LevelPackRing* rings;    // ringCount of them, in flying order
+
+	LevelPack() : rows(0), cols(0), chunkRows(0), chunkCount(0), ringCount(0), maxHeight(0), chunks(NULL), rings(NULL) {}
+};
+
+//Writes grid to filename in chunks of chunkRows rows. Returns false (leaving
+//no file) on failure, or if grid has no rings
+bool writeLevelPack(const LevelGrid& grid, int chunkRows, const char* filename);
+
+//Maps a file written by writeLevelPack. Returns false if it's missing or damaged,
+//which includes having no rings or any ring outside the level or with an
+//unknown movement
+bool openLevelPack(LevelPack& pack, const char* filename);
+
+void closeLevelPack(LevelPack& pack);
+
+//First row of chunk
+int getChunkRow(const LevelPack& pack, int chunk);
+
+//Rings of chunk, in flying order. Their rows count from getChunkRow
+const LevelPackRing* getChunkRings(const LevelPack& pack, int chunk, int& count);
+
+#endif /* LEVELPACK_H_ */
@@ -5,10 +5,29 @@
 
 #include <Windows.h>
 #include <gl/glut.h>
+#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <new>
 #include "mesh.h"
+#include "meshbuffer.h"
+#include "meshlod.h"
+#include "assetcache.h"
+#include "mipmap.h"
+#include "atlas.h"
+#include "arena.h"
+#include "level.h"
+#include "levelpack.h"
+#include "levelcache.h"
+#include "course.h"
+#include "rings.h"
+#include "proctex.h"
+#include "platform.h"
+#include "glfuncs.h"
+#include "jobs.h"
+#include "groundstream.h"
+#include "texupload.h"
 #include "imageloader.h"
 #include <Xinput.h>
 #pragma comment(lib, "XInput.lib")
@@ -33,24 +52,23 @@ typedef struct
 	int height;
 } mapParams;
 
-enum ringMovement
+typedef enum
 {
-	still,
-	horizontal,
-	vertical,
-	spinClock,
-	spinAntiClock
-};
-
-typedef struct ringList ringList;
-struct ringList
+	frontWall,
+	backWall,
+	leftWall,
+	rightWall,
+	ceilingWall,
+	floorWall,
+	ROOM_WALLS
+} roomWall;
+
+/* Corners and texture co-ordinates of every wall of a level's room */
+typedef struct
 {
-	vector3d position;
-	GLfloat angle;
-	enum ringMovement movement;
-	int direction;
-	ringList *next;
-};
+	GLfloat vertices[ROOM_WALLS][12];
+	GLfloat texCoords[ROOM_WALLS][8];
+} roomWalls;
 
 typedef enum
 {
@@ -73,11 +91,19 @@ void passiveMouse(int x, int y);
 void reshape(int width, int height);
 
 /* File input functions */
-int **readInput(char* filename, mapParams *levelParameters, int position);
-ringList *arrayToLinkedList(int **posMap, int **stateMap, mapParams *params);
-void storeRing(ringList **ringToProc,vector3d ringPos, int ringState);
-void mapsToLinkedLists(void);
-void freeLinkedList(ringList *list);
+void gridToRings(const LevelGrid *grid, int diff, RingStore *rings, int *height);
+void storeRing(RingStore *rings, vector3d ringPos, int ringState);
+enum ringMovement getRingMovement(int ringState);
+vector3d ringPosition(int ring);
+const RingStore *getLevelRings(CachedLevel *level, int diff, int *height);
+void streamRings(void);
+void prefetchLevel(int level, int buildRoom);
+int packRoomHeight(const LevelPack *pack, int diff);
+void waitForPrefetch(void);
+void streamCourse(void);
+void recyclePassedRings(void);
+int courseRowFits(const LevelCell *cells);
+void moveCourseBack(void);
 
 /* Velocity/position/force functions */
 void mouseAdjForce(int up, int down);
@@ -118,16 +144,21 @@ int findCurMenuBox(void);
 int checkMenuBox(const GLfloat *vertices);
 
 /* Texture functions */
-void loadTexture(GLuint texture, char *filename);
+bool loadTexture(Texture& texture, const char *filename, void *mips);
+void uploadMipLevels(Texture& texture, const unsigned char *pixels, const MipLevel *levels, int levelCount, int channels, const std::function<void(void)>& release);
 void setCoordArray(GLfloat *array, GLfloat e0, GLfloat e1, GLfloat e2, GLfloat e3, GLfloat e4, GLfloat e5, GLfloat e6, GLfloat e7, GLfloat e8, GLfloat e9, GLfloat e10, GLfloat e11);
 void setTexArray(GLfloat *array, GLfloat e0, GLfloat e1, GLfloat e2, GLfloat e3, GLfloat e4, GLfloat e5, GLfloat e6, GLfloat e7);
-void loadCheckerTexData(void);
+bool loadAtlasTexture(Texture& texture, const char *name, void *atlas);
+void buildRoomAtlas(const TextureMips* ground, const TextureMips* sky);
 
 /* Misc functions */
 void calcFps(void);
+void reportStartupPhase(const char *phase);
 void newGame(int computerGame, int reset);
 void nextLevel(void);
-void setWalls(void);
+void setWalls(int buildRoom);
+void placeWalls(const mapParams *params, int diff, roomWalls *walls);
+void buildRoomTriangles(const roomWalls *walls, int withFloor, std::vector<GLfloat> *triangles);
 void moveRings(void);
 
 /* Controller functions */
@@ -149,12 +180,13 @@ float controllerLTrig, controllerRTrig, controllerLThumbX, controllerLThumbY, co
 const int deadZone = XINPUT_GAMEPAD_LEFT_THUMB_DEADZONE;
 const GLfloat controllerMaxDirInc = 0.5;
 
-/* Variables relating to the ring arrays/linked lists */
+/* Variables relating to the ring arrays */
 //int totalRows, totalCols;
 //GLfloat maxHeight;
 //GLfloat midpoint;
-ringList *firstRing;
-ringList *currentRing;
+RingStore rings; // The current level's rings, in the order they're flown through
+int currentRing; // Index of the next ring to fly through, rings.count once they're all passed
+int lastCollision = -1, lastInside = -1; // Rings last hit and last flown through
 const GLfloat ringSpinInc = 1;
 #define OUTSIDE 0
 #define INSIDE 1
@@ -162,19 +194,44 @@ const GLfloat ringSpinInc = 1;
 
 /* Variables relating to difficulty */
 #define NO_DIFF_SETTINGS 3
+static_assert(NO_DIFF_SETTINGS == LEVEL_RING_LAYOUTS, "The level cache keeps a ring layout for each difficulty");
 #define EASY 0
 #define MEDIUM 1
 #define HARD 2
 int currentDiff = 1;
 
-/* Variables relating to levels */
-#define NO_LEVELS 4
-ringList *initialRing[NO_LEVELS] = {0};
+/* Variables relating to levels. They're listed at startup (see levelcache.h) and each is read the first
+   time it's played; its rings at each difficulty are built then too, and only copied after that */
+#define LEVEL_CACHE_BUDGET (64*1024*1024) // Bytes of levels not being flown kept in memory
 int currentLevel;
-mapParams levelParams[NO_LEVELS];
-
-int **posMaps[NO_LEVELS]; /* Pointer to the level map array */
-int **stateMaps[NO_LEVELS];
+CachedLevel *currentLevelData; /* Held from the cache while it's flown */
+mapParams levelParams; /* Of the level being flown */
+
+/* The next level, got from the cache and its rings copied and room built by a job while this level is flown, so
+   reaching the back wall only swaps them in. Nothing else touches them, or that level's data, until the job is
+   waited for */
+RingStore prefetchedRings;
+CachedLevel *prefetchedData;
+int prefetchedLevel = -1, prefetchedDiff, prefetchedHeight, prefetchedRingsReady;
+std::vector<GLfloat> prefetchedRoomTriangles;
+mapParams prefetchedRoomParams; /* What prefetchedRoomTriangles were built for */
+int prefetchedRoomFloor, prefetchedRoomReady;
+JobId prefetchJob = NO_JOB;
+
+/* Levels compiled by levelc are mapped rather than read, and their rings added a chunk at a time as the plane nears them */
+int nextChunk; /* First chunk of the current level's pack whose rings aren't in rings yet */
+#define RING_STREAM_DISTANCE 20000.0 // How far beyond the next ring a pack's rings are added, as far as can be seen
+
+/* Endless course (-endless seed): rows are made up ahead of the plane in place of a level and the rings flown
+   through are recycled, so memory and the work done each tick stay the same however long it's flown */
+int endlessCourse = FALSE;
+unsigned int courseSeed;
+CourseGenerator course;
+int courseRowOffset; /* Rows everything has been moved back by, see moveCourseBack */
+#define COURSE_COLS 4
+#define COURSE_RING_POOL 2048 // Rings kept, passed or not
+#define COURSE_ROOM_ROWS 1024 // Long enough for the plane and the rings ahead of it between moves back
+#define COURSE_MOVE_BACK_ROWS 256 // Once the plane is twice this far along, it and the rings are moved back this far
 
 /* Keyboard state variables */
 
@@ -190,6 +247,7 @@ viewpoint cameraAngle;
 /* Window size */
 int windowWidth = 1280;
 int windowHeight = 720;
+const GLfloat fieldOfView = 45.0; // Vertical, in degrees
 
 /* Mouse control */
 vector2d mousePos;
@@ -251,6 +309,7 @@ GLfloat backWallVertices[12];
 GLfloat ceilingVertices[12];
 GLfloat floorVertices[12];
 
+GLfloat frontWallTexCoords[8];
 GLfloat leftWallTexCoords[8];
 GLfloat rightWallTexCoords[8];
 GLfloat backWallTexCoords[8];
@@ -285,26 +344,56 @@ const unsigned int delay = 10;
 
 /* Mesh and texture stuff */
 #define PLANE_MESH_FILENAME "raptor.obj"
+#define MESH_LOAD_THREADS 4 // Only used when the mesh cache is missing or stale
+#define STARTUP_JOB_THREADS 3 // Worker threads loading assets at startup, 0 loads everything in order on the main thread
+#define PREFETCH_JOB_THREADS 1 // Worker threads getting the next level ready during play, 0 does it on the main thread as newGame ends, so the start of the level before waits instead
+#define STARTUP_TEXTURES 3 // Textures loaded from files: plane, ground and sky (just the plane when the room is procedural)
+#define TEXTURE_UPLOAD_BUDGET (2*1024*1024) // Bytes of texture uploaded per frame, 0 uploads each texture whole as it loads
+#define PACK_MESH_NORMAL_BITS 16 // 8 or 16 to keep the plane in the compact packed format, 0 to keep it as loaded
 #define PLANE_TEXTURE_FILENAME "raptor.bmp"
 
 #define SKY_TEXTURE_FILENAME "sky.bmp"
 #define GROUND_TEXTURE_FILENAME "ground.bmp"
 
-#define CHECKER_TEX_ROWS 128
-#define CHECKER_TEX_COLS 128
-GLubyte checkerTexData[CHECKER_TEX_ROWS][CHECKER_TEX_COLS][3];
+/* The walls, floor and ceiling share one atlas, so the room is drawn with one bind */
+#define ROOM_ATLAS_NAME "room atlas" // Built at startup, not loaded from a file
+#define PROCEDURAL_ROOM_TEXTURES TRUE // Generate the sky and ground instead of reading the bitmaps above
+#define PROC_TEXTURE_THREADS 4 // Threads generating each procedural texture
+#define MAX_TEXTURE_QUALITY 2 // Set with -quality 0 to 2 on the command line
+#define CHECKER_CELLS 16 // Squares across the checker tile
 
-Mesh planeMesh;
+/* Each quality step doubles the tile. With the gutter either side it's a power of
+   two, and the gutter keeps the tiles apart down to the 14 pixel mipmap */
+int textureQuality = 1;
+#define ROOM_ATLAS_TILE (224 << textureQuality)
+#define ROOM_ATLAS_GUTTER (16 << textureQuality)
+
+typedef enum
+{
+	checkerTile,
+	skyTile,
+	groundTile,
+	frontTile,
+	ROOM_TILES
+} roomTile;
+
+TextureAtlas roomAtlas;
+std::vector<GLfloat> roomTriangles; // x, y, z, u, v for every wall, rebuilt by setWalls unless the prefetch built them
+
+/* Large ground imagery, streamed in tiles around the plane. Cut from an image with tilecut; without it the floor uses the ground texture */
+#define GROUND_TILES_FILENAME "ground.tiles"
+#define GROUND_TILE_BUDGET (16*1024*1024) // Bytes of tiles kept in memory
+#define GROUND_TILE_WINDOW 1 // Tiles kept either side of the plane on every level
+
+MeshHandle planeMesh;
 vector3d planeCentre, planeMax, planeMin; // Centre co-ordinates of plane, max and mix co-ordinates (used for collisision detection)
 
-/* Array for opengl to store textures */
-const GLsizei numTextures = 4;
-GLuint texName[numTextures];
+/* Startup timing */
+double startupTime, lastStartupPhase;
+int firstFrameDrawn = FALSE;
 
-#define PLANE_TEXTURE_NUM 0
-#define GROUND_TEXTURE_NUM 1
-#define SKY_TEXTURE_NUM 2
-#define CHECKER_TEXTURE_NUM 3
+/* Textures, shared through the asset cache */
+TextureHandle planeTexture, roomTexture;
 
 /* The size of the textures (i.e how many times they are repeated along the shortest edge */
 const GLfloat wallTexSize = 1;
@@ -367,26 +456,98 @@ int main(int argc, char **argv)
 {
 //	printf("Vendor: %s\nRenderer: %s\nVersion: %s\nExtensions: %s\n",(const char*)glGetString( GL_VENDOR),(const char*)glGetString( GL_RENDERER),(const char*)glGetString( GL_VERSION),(const char*)glGetString( GL_EXTENSIONS));
 
-	detectController();
-	controllerMode = FALSE;
+	startupTime = lastStartupPhase = getSeconds();
 
-	/* Read levels */
+	/* Read before glutInit, which would complain about an option it doesn't know */
 	int i;
-	char buf[100];
-	for(i=0; i<NO_LEVELS; i++)
+	for(i=1; i<argc-1; i++)
 	{
-		sprintf(buf,"level%d.txt",i);
-		posMaps[i] = readInput(buf, &levelParams[i], TRUE);
-		stateMaps[i] = readInput(buf, &levelParams[i], FALSE);
+		if(strcmp(argv[i], "-quality") == 0)
+		{
+			textureQuality = atoi(argv[i+1]);
+			textureQuality = textureQuality < 0 ? 0 : (textureQuality > MAX_TEXTURE_QUALITY ? MAX_TEXTURE_QUALITY : textureQuality);
+		} else if(strcmp(argv[i], "-endless") == 0) {
+			endlessCourse = TRUE;
+			courseSeed = (unsigned int)strtoul(argv[i+1], NULL, 10);
+			printf("Endless course from seed %u\n", courseSeed);
+		} else {
+			continue;
+		}
+		memmove(&argv[i], &argv[i+2], (argc-i-1)*sizeof(char *));
+		argc -= 2;
+		i--;
 	}
 
-//	mapsToLinkedLists();
+	/* Only the levels' headers are read now, however many there are */
+	setLevelCacheBudget(LEVEL_CACHE_BUDGET);
+	if(findLevels(LEVEL_MANIFEST) == 0 && !endlessCourse)
+	{
+		fputs("Error, no levels found.\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+	reportStartupPhase("levels listed");
+
+	/* Everything that doesn't need OpenGL is loaded by jobs while GLUT sets up
+	   the window; only the uploads wait for the main thread */
+	startJobPool(STARTUP_JOB_THREADS);
+
+	/* The first level is read like the next one is during play */
+	prefetchLevel(0, FALSE);
+
+	/* Mesh for plane */
+	Mesh *planeMeshData = new Mesh;
+	JobId meshJob = submitJob("mesh " PLANE_MESH_FILENAME, [planeMeshData]()
+	{
+		loadMesh(*planeMeshData, PLANE_MESH_FILENAME, MESH_LOAD_THREADS);
+	});
+
+	/* Textures: decode the bitmap (or map its container), then build the mipmaps */
+	const char *textureFiles[STARTUP_TEXTURES] = {PLANE_TEXTURE_FILENAME, GROUND_TEXTURE_FILENAME, SKY_TEXTURE_FILENAME};
+	int fileTextures = PROCEDURAL_ROOM_TEXTURES ? 1 : STARTUP_TEXTURES;
+	TextureMips textureMips[STARTUP_TEXTURES];
+	bool textureRead[STARTUP_TEXTURES];
+	JobId textureJobs[STARTUP_TEXTURES];
+	for(i=0; i<fileTextures; i++)
+	{
+		TextureMips *mips = &textureMips[i];
+		bool *read = &textureRead[i];
+		const char *filename = textureFiles[i];
+		std::string name = std::string("read ") + filename;
+		JobId readJob = submitJob(name.c_str(), [mips, read, filename]()
+		{
+			*read = readTextureMips(*mips, filename);
+		});
+		name = std::string("mipmaps ") + filename;
+		textureJobs[i] = submitJob(name.c_str(), [mips]()
+		{
+			buildTextureMips(*mips);
+		}, readJob);
+	}
+
+	/* The ground and sky then go into the room atlas along with the generated tiles
+	   (or are generated with them, needing nothing from disk) */
+	TextureMips *groundMips = NULL, *skyMips = NULL;
+	std::vector<JobId> atlasInputs;
+	if(!PROCEDURAL_ROOM_TEXTURES)
+	{
+		groundMips = &textureMips[1];
+		skyMips = &textureMips[2];
+		atlasInputs.assign(textureJobs + 1, textureJobs + STARTUP_TEXTURES);
+	}
+	JobId atlasJob = submitJob(ROOM_ATLAS_NAME, [groundMips, skyMips]()
+	{
+		buildRoomAtlas(groundMips, skyMips);
+	}, atlasInputs);
+	reportStartupPhase("jobs queued");
+
+	detectController();
+	controllerMode = FALSE;
 
 	currentLevel = 0;
 
 	cameraAngle = behind;
 
-//	firstRing = currentRing = initialRing[currentLevel];
+//	currentRing = 0;
 
 	/* Initialise the GLUT window manager */
 	glutInit(&argc, argv);       
@@ -404,24 +565,61 @@ int main(int argc, char **argv)
 	glutIdleFunc(idle);
 	glutPassiveMotionFunc(passiveMouse);
 	glutReshapeFunc(reshape);
+	reportStartupPhase("window created");
+
+	/* Initialise OpenGL*/
+	initGl();
+	reportStartupPhase("OpenGL initialised");
+
+	/* Upload the textures as their jobs finish */
+	waitForJob(textureJobs[0]);
+	if(textureRead[0])
+		planeTexture = acquireTexture(textureFiles[0], loadTexture, &textureMips[0]);
+	waitForJob(atlasJob);
+	for(i=0; i<fileTextures; i++)
+		freeTextureMips(textureMips[i]);
+	roomTexture = acquireTexture(ROOM_ATLAS_NAME, loadAtlasTexture, &roomAtlas);
+	if(!planeTexture || !roomTexture)
+	{
+		fputs("Error, could not load textures.\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+	reportStartupPhase("textures uploaded");
 
-	/* Load mesh  for plane */
-	loadMesh(planeMesh, PLANE_MESH_FILENAME);
+	/* The cache takes the parsed plane, keeps it on the GPU and holds it in memory only in the packed format (if it can't be uploaded it stays as loaded and drawMesh falls back to immediate mode) */
+	waitForJob(meshJob);
+	planeMesh = acquireMesh(PLANE_MESH_FILENAME, MESH_LOAD_THREADS, planeMeshData, PACK_MESH_NORMAL_BITS);
+	if(!planeMesh)
+	{
+		fputs("Error, could not load plane mesh.\n", stderr);
+		exit(EXIT_FAILURE);
+	}
 
-	/* Find centre, max and min co-ordinates */
-	planeCentre = vectorConvert(getCentroid(planeMesh));
-	planeMax = vectorConvert(getMax(planeMesh));
-	planeMin = vectorConvert(getMin(planeMesh));
+	reportStartupPhase("mesh uploaded");
+
+	/* Centre, max and min co-ordinates were found while loading */
+	planeCentre = vectorConvert(planeMesh->centroid);
+	planeMax = vectorConvert(planeMesh->bounds_max);
+	planeMin = vectorConvert(planeMesh->bounds_min);
 
 	/* We rotate the plane when we draw it, so we need to rotate the centre, max and min also */
 	planeCentre = set3DVector(planeCentre.y, planeCentre.z, planeCentre.x);
 	planeMax = set3DVector(planeMax.y, planeMax.z, planeMax.x);
 	planeMin = set3DVector(planeMin.y, planeMin.z, planeMin.x);
 
-	/* Initialise OpenGL*/
-	initGl();
+	waitForPrefetch();
+	reportStartupPhase("first level read");
+
+	printJobReport();
+	stopJobPool();
+	startJobPool(PREFETCH_JOB_THREADS);
+	printAssetCacheStats();
+
+	if(!openGroundStream(GROUND_TILES_FILENAME, GROUND_TILE_BUDGET, GROUND_TILE_WINDOW))
+		printf("No streamed ground in %s, the floor uses %s\n", GROUND_TILES_FILENAME, PROCEDURAL_ROOM_TEXTURES ? "the generated ground" : GROUND_TEXTURE_FILENAME);
 
 	newGame(TRUE, TRUE);
+	reportStartupPhase("game started");
 
 	/* Loop forever and ever (but still call callback functions...) */
 	glutMainLoop();
@@ -429,8 +627,19 @@ int main(int argc, char **argv)
 	return(EXIT_SUCCESS);
 }
 
+/* Prints how long startup has taken so far, and since the previous phase */
+void reportStartupPhase(const char *phase)
+{
+	double now = getSeconds();
+	printf("Startup: %-20s %8.1f ms (%.1f ms total)\n", phase, (now - lastStartupPhase)*1000.0, (now - startupTime)*1000.0);
+	lastStartupPhase = now;
+}
+
 void initGl(void)
 {
+	initGlFunctions(); /* Look up the post 1.1 functions we use */
+	setTextureUploadBudget(TEXTURE_UPLOAD_BUDGET);
+
 	reshape(windowWidth, windowHeight); /* Set up field of view */
 
 //	glClearColor (0.529, 0.808, 0.980, 1.0); /* Set background colour to blue */
@@ -463,13 +672,6 @@ void initGl(void)
 	glFogf(GL_FOG_END,fogEndDepth); // End depth
 	glEnable(GL_FOG);
 
-	/* Load the textures */
-	glGenTextures(numTextures, texName);
-	loadTexture(PLANE_TEXTURE_NUM, PLANE_TEXTURE_FILENAME);
-	loadTexture(GROUND_TEXTURE_NUM, GROUND_TEXTURE_FILENAME);
-	loadTexture(SKY_TEXTURE_NUM, SKY_TEXTURE_FILENAME);
-	loadCheckerTexData();
-
 //	setWalls();
 }
 
@@ -478,6 +680,10 @@ void display(void)
 {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); /*Clear color and depth buffers*/
 
+	/* Carry on with texture levels still waiting to go to the GPU */
+	if(pumpTextureUploads())
+		printTextureUploadStats();
+
 	glMatrixMode(GL_MODELVIEW); /* GL_MODELVIEW is used to set up the model and translate into camera space */
 	glLoadIdentity(); /* Initialise to identity matirix */
 
@@ -485,26 +691,32 @@ void display(void)
 //	gluLookAt(-5,0,0, 0,0,0, 0,1,0); // Debug - directly behind view
 //	gluLookAt(0,100,0, 0,0,0, 1,0,0); // Debug - directly above view
 
+	vector3d eye; // Camera position relative to the plane, used to pick the plane's detail level
 	switch (cameraAngle)
 	{
 		case behind: default:
-			gluLookAt(-5,0.5,0, 1,0,0, 0,1,0); // Normal ("behind") camera view
+			eye = set3DVector(-5,0.5,0);
+			gluLookAt(eye.x,eye.y,eye.z, 1,0,0, 0,1,0); // Normal ("behind") camera view
 			break;
 
 		case cockpit:
-			gluLookAt(planeMax.x,0,0, planeMax.x +1,0,0, 0,1,0);
+			eye = set3DVector(planeMax.x,0,0);
+			gluLookAt(eye.x,eye.y,eye.z, planeMax.x +1,0,0, 0,1,0);
 			break;
 
 		case above:
-			gluLookAt(-5,5,0, 1,0,0, 0,1,0);
+			eye = set3DVector(-5,5,0);
+			gluLookAt(eye.x,eye.y,eye.z, 1,0,0, 0,1,0);
 			break;
 
 		case rightSide:
-			gluLookAt(-5,0,5, 1,0,0, 0,1,0);
+			eye = set3DVector(-5,0,5);
+			gluLookAt(eye.x,eye.y,eye.z, 1,0,0, 0,1,0);
 			break;
 
 		case leftSide:
-			gluLookAt(-5,0,-5, 1,0,0, 0,1,0);
+			eye = set3DVector(-5,0,-5);
+			gluLookAt(eye.x,eye.y,eye.z, 1,0,0, 0,1,0);
 			break;
 
 
@@ -550,61 +762,44 @@ void display(void)
 	glRotatef(radsToDegs*sin(normalisedDir.z),0.0,1.0,0.0); /* L/R rotation */
 	glRotatef(radsToDegs*sin(normalisedDir.y),1.0,0.0,0.0); /* U/D rotation */
 
-	/* Draw the plane */
+	/* Draw the plane, in less detail when it's small on screen */
+	int planeLod = selectMeshLod(*planeMesh, vectorMag(vectorAdd(eye, vectorInvert(planeCentre))), fieldOfView, windowHeight);
+
 	glEnable(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, PLANE_TEXTURE_NUM);
-	drawMesh(planeMesh);
+	glBindTexture(GL_TEXTURE_2D, planeTexture->name);
+	drawMesh(*planeMesh, planeLod);
 	glDisable(GL_TEXTURE_2D);
 
 	glPopMatrix();
 
 	/* Draw the rings */
 	glColor3f(1.0,0.0,0.0); // Draw first ring in red
-	ringList *nextToDraw = currentRing;
-	while(nextToDraw != NULL)
+	for(int ring = currentRing; ring < rings.count; ring++)
 	{
+		int slot = rings.slot[ring];
 		glPushMatrix();
-		glTranslatef(nextToDraw->position.x,nextToDraw->position.y, nextToDraw->position.z); /* Distance then height then left/right */
-		glRotatef(90.0 + nextToDraw->angle,0.0,1.0,0.0);
+		glTranslatef(rings.x[slot], rings.y[slot], rings.z[slot]); /* Distance then height then left/right */
+		glRotatef(90.0 + rings.angle[slot],0.0,1.0,0.0);
 		glutSolidTorus(torusInnerRad[currentDiff],torusOuterRad[currentDiff],torusSides,torusRings);
 		glPopMatrix();
 
 		glColor3f(0.0,0.0,1.0); // Draw remaining rings in green
-		nextToDraw = nextToDraw->next;
 	}
 
-	/* Draw walls */
-	glColor3f(0.0,1.0,0.0); /* Draw untextured walls in green */
-
-
-	glVertexPointer(3,GL_FLOAT,0,frontWallVertices);
-	glDrawArrays(GL_POLYGON,0,4);
-
+	/* Draw walls, all from the room atlas (the front wall's tile is plain green) */
 	glEnable(GL_TEXTURE_2D);
 	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-	glBindTexture(GL_TEXTURE_2D, CHECKER_TEXTURE_NUM);
-	glVertexPointer(3,GL_FLOAT,0,backWallVertices);
-	glTexCoordPointer(2,GL_FLOAT,0,backWallTexCoords);
-	glDrawArrays(GL_POLYGON,0,4);
-
+	glBindTexture(GL_TEXTURE_2D, roomTexture->name);
+	glVertexPointer(3,GL_FLOAT,5*sizeof(GLfloat),&roomTriangles[0]);
+	glTexCoordPointer(2,GL_FLOAT,5*sizeof(GLfloat),&roomTriangles[3]);
+	glDrawArrays(GL_TRIANGLES,0,(GLsizei)(roomTriangles.size()/5));
 
-	glBindTexture(GL_TEXTURE_2D, SKY_TEXTURE_NUM);
-	glVertexPointer(3,GL_FLOAT,0,rightWallVertices);
-	glTexCoordPointer(2,GL_FLOAT,0,rightWallTexCoords);
-	glDrawArrays(GL_POLYGON,0,4);
-
-	glVertexPointer(3,GL_FLOAT,0,leftWallVertices);
-	glTexCoordPointer(2,GL_FLOAT,0,leftWallTexCoords);
-	glDrawArrays(GL_POLYGON,0,4);
-
-	glVertexPointer(3,GL_FLOAT,0,ceilingVertices);
-	glTexCoordPointer(2,GL_FLOAT,0,ceilingTexCoords);
-	glDrawArrays(GL_POLYGON,0,4);
-
-	glBindTexture(GL_TEXTURE_2D, GROUND_TEXTURE_NUM);
-	glVertexPointer(3,GL_FLOAT,0,floorVertices);
-	glTexCoordPointer(2,GL_FLOAT,0,floorTexCoords);
-	glDrawArrays(GL_POLYGON,0,4);
+	/* The floor, when it's streamed, follows the plane (u runs along z and v along x, as the floor's texture did) */
+	if(groundStreamOpen())
+	{
+		updateGroundStream((pos.z - floorVertices[2])/(floorVertices[5] - floorVertices[2]), (pos.x - floorVertices[0])/(floorVertices[9] - floorVertices[0]));
+		drawGroundStream(floorVertices);
+	}
 
 	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
 	glDisable(GL_TEXTURE_2D);
@@ -651,6 +846,11 @@ void display(void)
 	
 	glFlush(); /* Execute all isssued commands */
 
+	if(!firstFrameDrawn)
+	{
+		reportStartupPhase("first frame");
+		firstFrameDrawn = TRUE;
+	}
 }
 
 /* This callback occurs upon button press */
@@ -667,6 +867,7 @@ void mouse(int button, int state, int x, int y)
 					menuMode = difficulty;
 					break;
 				case 3:
+					printGroundStreamStats();
 					exit(EXIT_SUCCESS);
 					break;
 				default:
@@ -701,67 +902,6 @@ void mouse(int button, int state, int x, int y)
 
 }
 
-int **readInput(char* filename, mapParams *levelParameters, int position)
-{
-
-	/* Open file */
-	FILE *filePtr;
-	filePtr = fopen(filename,"r");
-	if(filePtr == NULL)
-	{
-		fputs("Error, could not open input file.\n", stderr);
-		exit(EXIT_FAILURE);
-	}
-
-	/* Determine map size */
-
-	if (fscanf(filePtr,"%d%d", &(levelParameters->rows), &(levelParameters->cols)) < 2)
-	{
-		fputs("Error, could not read input file.\n", stderr);
-		exit(EXIT_FAILURE);
-	}
-
-//	midpoint = (totalCols-1)/(GLfloat)2; // Midpoint of the ring array, aligned with zero in real-world.
-
-	int **map;
-
-	/* Allocate map */
-	int i;
-	map = (int **)malloc(levelParameters->rows * sizeof(int *));
-	for(i = 0; i < levelParameters->rows; i++)
-		map[i] = (int *)malloc(levelParams->cols * sizeof(int));
-
-	/* Read input to map */
-	int j;
-	int c;
-	for(i=0; i < levelParameters->rows; i++)
-		for(j=0; j < levelParameters->cols; j++)
-		{
-			if(position)
-			{
-				if (fscanf(filePtr,"%*1s%d", &map[i][j]) != 1)
-				{
-					fputs("Error, could not read input file.\n", stderr);
-					exit(EXIT_FAILURE);
-				}
-			} else {
-				do
-				{
-					c = fgetc(filePtr);
-					if( c == EOF)
-					{
-						puts("File reading Error");
-						exit(EXIT_FAILURE);
-					}
-				} while( c != 'S' && c != 'H' && c != 'V' && c != 'C' && c != 'A');
-
-				map[i][j] = c;
-			}
-		}
-		fclose(filePtr);
-	return map;
-}
-
 void controllerAdjForce(GLfloat accelerate, GLfloat brake)
 {
 
@@ -856,12 +996,10 @@ void timer(int x)
 	}
 
 	/* Collision test */
-	static ringList *lastCollision = NULL;
-	static ringList *lastInside = NULL;
 	int ringState;
-	if(currentRing!= NULL)
+	if(currentRing < rings.count)
 		{
-			ringState = ringCollDetect(currentRing->position, currentRing->angle);
+			ringState = ringCollDetect(ringPosition(currentRing), rings.angle[rings.slot[currentRing]]);
 			if(ringState == COLLIDED && lastCollision != currentRing && !autopilot) // Detect a collision with the ring
 			{
 				lives--;
@@ -1045,12 +1183,12 @@ void timer(int x)
 	{
 		force = autopilotForce;
 
-		if(currentRing != NULL)
+		if(currentRing < rings.count)
 		{
-			if(pos.x > currentRing->position.x - torusInnerRad[currentDiff])
+			if(pos.x > ringPosition(currentRing).x - torusInnerRad[currentDiff])
 			{
-				if(currentRing ->next != NULL)
-					direction = vectorAdd(currentRing->next->position, vectorInvert(pos));
+				if(currentRing + 1 < rings.count)
+					direction = vectorAdd(ringPosition(currentRing + 1), vectorInvert(pos));
 				else
 				{
 					direction.x = 1;
@@ -1058,7 +1196,7 @@ void timer(int x)
 					direction.z = 0;
 				}
 			} else {
-				direction = vectorAdd(currentRing->position, vectorInvert(pos));
+				direction = vectorAdd(ringPosition(currentRing), vectorInvert(pos));
 //				if(pos.x > (currentRing->position.x - 5*torusOuterRad[currentDiff]) && abs(sin(currentRing->angle)) > 0.5)
 //				{
 //					printf("%f\n", abs(sin(currentRing->angle)));
@@ -1106,14 +1244,14 @@ void timer(int x)
 	calculatePosition();
 
 	/* Check if we are passed the current ring, if so move to the next */
-	if(currentRing != NULL)
+	if(currentRing < rings.count)
 	{
-		if(currentRing->position.x + torusInnerRad[currentDiff] < pos.x + planeMin.x) // If we are passed the ring
+		if(ringPosition(currentRing).x + torusInnerRad[currentDiff] < pos.x + planeMin.x) // If we are passed the ring
 		{
 			if(lastInside != currentRing && !autopilot)
 				score -= 5;
 
-			currentRing = currentRing->next;
+			currentRing++;
 		}
 	}
 	
@@ -1371,18 +1509,48 @@ void reshape(int width, int height)
 
 	glViewport(0,0,windowWidth, windowHeight);
 
-	gluPerspective(45.0, (GLdouble)windowWidth/(GLdouble)windowHeight, 1.0, 20000.0); /* Set up the field of view as perspective */
+	gluPerspective(fieldOfView, (GLdouble)windowWidth/(GLdouble)windowHeight, 1.0, 20000.0); /* Set up the field of view as perspective */
 	glMatrixMode(GL_MODELVIEW);
 }
 
-void loadTexture(GLuint texture, char *filename)
+/* Queues a prebuilt mipmap chain for upload, skipping any levels larger than the driver allows. release frees the pixels once they're on the GPU */
+void uploadMipLevels(Texture& texture, const unsigned char *pixels, const MipLevel *levels, int levelCount, int channels, const std::function<void(void)>& release)
+{
+	GLint maxSize;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+
+	int first = 0;
+	while(first < levelCount - 1 && (levels[first].width > maxSize || levels[first].height > maxSize))
+		first++;
+
+	texture.width = levels[first].width;
+	texture.height = levels[first].height;
+	texture.bytes = 0;
+	for(int i = first; i < levelCount; i++)
+		texture.bytes += (size_t)levels[i].width*levels[i].height*3;
+
+	queueTextureUpload(texture.name, pixels, levels + first, levelCount - first, channels, release);
+}
+
+bool loadTexture(Texture& texture, const char *filename, void *mips)
 {
-	Image *img;
-	img = loadBMP(filename);
+	/* The mipmaps are normally prepared by a startup job; load them here otherwise.
+	   Either way they're taken over, to be freed once they're uploaded */
+	TextureMips *textureMips = new TextureMips;
+	if(mips != NULL)
+		moveTextureMips(*(TextureMips *)mips, *textureMips);
+	else
+		loadTextureMips(*textureMips, filename);
+	if(textureMips->levelCount == 0)
+	{
+		freeTextureMips(*textureMips);
+		delete textureMips;
+		return false;
+	}
 
 	glEnable(GL_TEXTURE);
 
-	glBindTexture(GL_TEXTURE_2D, texture);
+	glBindTexture(GL_TEXTURE_2D, texture.name);
 
 	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_DECAL);
 
@@ -1391,11 +1559,15 @@ void loadTexture(GLuint texture, char *filename)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 
-//	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, img->width -1, img->height -1, 0, GL_RGB, GL_UNSIGNED_BYTE, img->pixels);
-
-	gluBuild2DMipmaps(GL_TEXTURE_2D, 3, img->width, img->height, GL_RGB, GL_UNSIGNED_BYTE, img->pixels);
+	/* The levels come from the container baked by texconv, or were built from the bitmap and saved for next time */
+	uploadMipLevels(texture, textureMips->pixels, textureMips->levels, textureMips->levelCount, textureMips->channels, [textureMips]()
+	{
+		freeTextureMips(*textureMips);
+		delete textureMips;
+	});
 
 	glDisable(GL_TEXTURE);
+	return true;
 }
 
 void setCoordArray(GLfloat *array, GLfloat e0, GLfloat e1, GLfloat e2, GLfloat e3, GLfloat e4, GLfloat e5, GLfloat e6, GLfloat e7, GLfloat e8, GLfloat e9, GLfloat e10, GLfloat e11)
@@ -1427,88 +1599,78 @@ void setTexArray(GLfloat *array, GLfloat e0, GLfloat e1, GLfloat e2, GLfloat e3,
 }
 
 
-ringList *arrayToLinkedList(int **posMap, int **stateMap, mapParams *params)
+void gridToRings(const LevelGrid *grid, int diff, RingStore *rings, int *height)
 {
 	vector3d ringPos; // Stores the position co-ordinates of the current ring
-//	int ringID = 0; // An identifier to store the current ring
 	int i,j;
 
-	params->height = 0;
-	GLfloat midpoint = (GLfloat)( params->cols -1) / 2.0;
+	*height = 0;
+	GLfloat midpoint = (GLfloat)( grid->cols -1) / 2.0;
 
-	ringList *firstRing = NULL, *currentRing = NULL;
+	/* Count the rings first, so each goes straight into its place in its movement's group */
+	int counts[RING_MOVEMENTS] = {0};
+	for(i=0; i < grid->rows*grid->cols; i++)
+		if(grid->cells[i].height != 0)
+			counts[getRingMovement(grid->cells[i].movement)]++;
+	reserveRingGroups(*rings, counts);
 
 	/* Loop across all rows */
-	for(i=0; i < params->rows; i++)
+	for(i=0; i < grid->rows; i++)
 	{
-		ringPos.x = (GLfloat)(dirSclr[currentDiff].x*(i+1));
-		for(j=0; j < params->cols; j++)
+		ringPos.x = (GLfloat)(dirSclr[diff].x*(i+1));
+		for(j=0; j < grid->cols; j++)
 		{
-			if(posMap[i][j] != 0) // i.e if there is a ring in the space
+			const LevelCell& cell = grid->at(i, j);
+			if(cell.height != 0) // i.e if there is a ring in the space
 			{
-				ringPos.y = (GLfloat)(dirSclr[currentDiff].y*posMap[i][j])/(GLfloat)3.0;
-				ringPos.z = dirSclr[currentDiff].z*(j - midpoint);
-
-				if(ringPos.y > params->height)
-					params->height = ringPos.y;
+				ringPos.y = (GLfloat)(dirSclr[diff].y*cell.height)/(GLfloat)3.0;
+				ringPos.z = dirSclr[diff].z*(j - midpoint);
 
-				storeRing(&currentRing, ringPos, stateMap[i][j]);
+				if(ringPos.y > *height)
+					*height = ringPos.y;
 
-				if(firstRing == NULL)
-					firstRing = currentRing;
-
-//				ringID++; // Increment ring ID
+				storeRing(rings, ringPos, cell.movement);
 			}
 		}
 	}
+}
 
-	/* Add map freeing routine here */
-	return firstRing;
-
+/* Centre of a ring of the current level, counting in the order they're flown through */
+vector3d ringPosition(int ring)
+{
+	int slot = rings.slot[ring];
+	return set3DVector(rings.x[slot], rings.y[slot], rings.z[slot]);
 }
 
-void storeRing(ringList **ringToProc,vector3d ringPos, int ringState)
+void storeRing(RingStore *rings, vector3d ringPos, int ringState)
 {
-	if(*ringToProc == NULL)
-	{
-		*ringToProc = (ringList*) malloc(sizeof(ringList));
-	} else {
-		(*ringToProc)->next = (ringList*) malloc(sizeof(ringList));
-		(*ringToProc) = (*ringToProc)->next;
-	}
+	addRing(*rings, ringPos.x, ringPos.y, ringPos.z, getRingMovement(ringState));
+}
 
-	(*ringToProc)->next = NULL;
-	(*ringToProc)->position = ringPos;
-	(*ringToProc)->direction = TRUE;
-	(*ringToProc)->angle = 0;
+enum ringMovement getRingMovement(int ringState)
+{
 	switch(ringState)
 	{
 		case 'S':
-			(*ringToProc)->movement = still;
-			break;
+			return still;
 
 		case 'H':
-			(*ringToProc)->movement = horizontal;
-			break;
+			return horizontal;
 
 		case 'V':
-			(*ringToProc)->movement = vertical;
-			break;
+			return vertical;
 
 		case 'C':
-			(*ringToProc)->movement = spinClock;
-			break;
+			return spinClock;
 
 		case 'A':
-			(*ringToProc)->movement = spinAntiClock;
-			break;
+			return spinAntiClock;
 
 		default:
 			fputs("Incorrect direction specifier.\n", stderr);
 			exit(EXIT_FAILURE);
-			break;
+			return still;
 	}
-
 }
 
 
@@ -1659,8 +1821,70 @@ void newGame(int computerGame, int reset)
 		elapsedTime = 0;
 	}
 
-	mapsToLinkedLists();
-	currentRing = firstRing = initialRing[currentLevel];
+	currentRing = 0;
+	waitForPrefetch();
+	int roomReady = FALSE;
+	if(endlessCourse)
+	{
+		/* In place of the level's, a room that the plane is kept inside by moveCourseBack */
+		levelParams.rows = COURSE_ROOM_ROWS;
+		levelParams.cols = COURSE_COLS;
+		levelParams.height = (int)((GLfloat)(dirSclr[currentDiff].y*COURSE_MAX_HEIGHT)/(GLfloat)3.0);
+		reserveRings(rings, COURSE_RING_POOL);
+		emptyRings(rings);
+		recycleRings(rings, 0);
+		startCourse(course, courseSeed, COURSE_COLS);
+		courseRowOffset = 0;
+		streamCourse();
+	} else {
+		/* Ready if the prefetch job got it, otherwise from the cache (read now if it isn't there) */
+		CachedLevel *data = NULL;
+		if(prefetchedLevel == currentLevel)
+		{
+			data = prefetchedData;
+			prefetchedData = NULL;
+		}
+		if(data == NULL)
+			data = acquireLevel(currentLevel);
+		if(data == NULL)
+		{
+			fputs("Error, could not read input file.\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+		if(currentLevelData != NULL)
+			releaseLevel(currentLevelData);
+		currentLevelData = data;
+		LevelInfo info = getLevelInfo(currentLevel);
+		levelParams.rows = info.rows;
+		levelParams.cols = info.cols;
+
+		if(data->pack.chunks != NULL)
+		{
+			levelParams.height = packRoomHeight(&data->pack, currentDiff);
+			emptyRings(rings);
+			nextChunk = 0;
+			streamRings();
+		} else if(prefetchedLevel == currentLevel && prefetchedDiff == currentDiff && prefetchedRingsReady) {
+			swapRings(prefetchedRings, rings);
+			levelParams.height = prefetchedHeight;
+		} else {
+			copyRings(*getLevelRings(data, currentDiff, &levelParams.height), rings);
+		}
+
+		if(prefetchedLevel == currentLevel && prefetchedDiff == currentDiff && prefetchedRoomReady && prefetchedRoomFloor == !groundStreamOpen()
+			&& prefetchedRoomParams.rows == levelParams.rows && prefetchedRoomParams.cols == levelParams.cols && prefetchedRoomParams.height == levelParams.height)
+		{
+			roomTriangles.swap(prefetchedRoomTriangles);
+			roomReady = TRUE;
+		}
+	}
+	if(prefetchedData != NULL)
+	{
+		releaseLevel(prefetchedData);
+		prefetchedData = NULL;
+	}
+	prefetchedLevel = -1;
+	lastCollision = lastInside = -1;
 
 /*
 	setCoordArray(frontWallVertices, xLwrBnd, yLwrBnd, zLwrBnd,
@@ -1686,47 +1910,158 @@ void newGame(int computerGame, int reset)
 		autopilot = FALSE;
 	}
 
-	setWalls();
+	setWalls(!roomReady);
 
-	pos.x = (currentRing->position.x + frontWallVertices[0])/2.0;
+	pos.x = (ringPosition(currentRing).x + frontWallVertices[0])/2.0;
 	pos.y = (frontWallVertices[1] + frontWallVertices[7])/2.0;
 	pos.z = (frontWallVertices[2] + frontWallVertices[8])/2.0;
+
+	prefetchLevel(currentLevel + 1, TRUE);
 }
 
-/* Generate checker pattern, adapted from http://www.csc.villanova.edu/~mdamian/Past/graphicsS13/notes/GLTextures/Checkerboard.htm */
-void loadCheckerTexData(void)
+/* Starts a job getting level from the cache and, unless they stream from a pack, its rings ready to swap in. With
+   buildRoom it builds the level's room too, which needs the room atlas (so not while starting up) */
+void prefetchLevel(int level, int buildRoom)
 {
-   int value;
-   for (int row = 0; row < CHECKER_TEX_ROWS; row++) {
-      for (int col = 0; col < CHECKER_TEX_COLS; col++) {
-         // Each cell is 8x8, value is 0 or 255 (black or white)
-         value = (((row & 0x8) == 0) ^ ((col & 0x8) == 0)) * 255;
-         checkerTexData[row][col][0] = (GLubyte)value;
-         checkerTexData[row][col][1] = (GLubyte)value;
-         checkerTexData[row][col][2] = (GLubyte)value;
-      }
-   }
+	if(endlessCourse || level >= getLevelCount())
+		return;
 
-   	glEnable(GL_TEXTURE);
+	prefetchedLevel = level;
+	prefetchedDiff = currentDiff;
+	prefetchedRingsReady = prefetchedRoomReady = FALSE;
+	int diff = currentDiff;
+	int withFloor = !groundStreamOpen();
+	prefetchJob = submitJob("prefetch level", [level, diff, buildRoom, withFloor]()
+	{
+		prefetchedData = acquireLevel(level);
+		if(prefetchedData == NULL)
+			return;
+
+		mapParams params;
+		LevelInfo info = getLevelInfo(level);
+		params.rows = info.rows;
+		params.cols = info.cols;
+		if(prefetchedData->pack.chunks == NULL)
+		{
+			copyRings(*getLevelRings(prefetchedData, diff, &prefetchedHeight), prefetchedRings);
+			prefetchedRingsReady = TRUE;
+			params.height = prefetchedHeight;
+		} else {
+			params.height = packRoomHeight(&prefetchedData->pack, diff);
+		}
 
-	glBindTexture(GL_TEXTURE_2D, CHECKER_TEXTURE_NUM);
+		if(buildRoom)
+		{
+			roomWalls walls;
+			placeWalls(&params, diff, &walls);
+			buildRoomTriangles(&walls, withFloor, &prefetchedRoomTriangles);
+			prefetchedRoomParams = params;
+			prefetchedRoomFloor = withFloor;
+			prefetchedRoomReady = TRUE;
+		}
+	});
+}
+
+/* Height of the room for a level from a pack, truncated like the height of a level read from text */
+int packRoomHeight(const LevelPack *pack, int diff)
+{
+	return (int)((GLfloat)(dirSclr[diff].y*pack->maxHeight)/(GLfloat)3.0);
+}
+
+/* Finishes the prefetch job, if there is one, so its level can be used */
+void waitForPrefetch(void)
+{
+	if(prefetchJob != NO_JOB)
+	{
+		waitForJob(prefetchJob);
+		prefetchJob = NO_JOB;
+	}
+}
+
+/* Packs the ground and sky with a generated checker and a plain green tile for the front wall.
+   Without bitmaps for the ground and sky (NULL), they're generated too, at the tile size */
+void buildRoomAtlas(const TextureMips* ground, const TextureMips* sky)
+{
+	if((ground != NULL && ground->levelCount == 0) || (sky != NULL && sky->levelCount == 0))
+		return;
+
+	/* Drawn at the tile size so its edges stay sharp */
+	ProcTextureParams checkerParams(procChecker, ROOM_ATLAS_TILE);
+	checkerParams.cells = CHECKER_CELLS;
+	ProcTextureHandle checker = getProcTexture(checkerParams, PROC_TEXTURE_THREADS);
+	const GLubyte green[3] = {0, 255, 0};
+
+	/* Same order as roomTile. The checker used GL_REPEAT, the bitmaps GL_MIRRORED_REPEAT. The
+	   generated ground tiles, but the sky's gradient only matches itself mirrored */
+	AtlasSource sources[ROOM_TILES] = {
+		{&checker->pixels[0], ROOM_ATLAS_TILE, ROOM_ATLAS_TILE, 4, atlasRepeat},
+		{NULL, ROOM_ATLAS_TILE, ROOM_ATLAS_TILE, 4, atlasMirroredRepeat},
+		{NULL, ROOM_ATLAS_TILE, ROOM_ATLAS_TILE, 4, atlasRepeat},
+		{green, 1, 1, 3, atlasRepeat}
+	};
+	ProcTextureHandle generatedSky, generatedGround;
+	if(sky != NULL)
+	{
+		AtlasSource source = {sky->pixels, sky->levels[0].width, sky->levels[0].height, sky->channels, atlasMirroredRepeat};
+		sources[skyTile] = source;
+	} else {
+		generatedSky = getProcTexture(ProcTextureParams(procSky, ROOM_ATLAS_TILE), PROC_TEXTURE_THREADS);
+		sources[skyTile].pixels = &generatedSky->pixels[0];
+	}
+	if(ground != NULL)
+	{
+		AtlasSource source = {ground->pixels, ground->levels[0].width, ground->levels[0].height, ground->channels, atlasMirroredRepeat};
+		sources[groundTile] = source;
+	} else {
+		generatedGround = getProcTexture(ProcTextureParams(procGround, ROOM_ATLAS_TILE), PROC_TEXTURE_THREADS);
+		sources[groundTile].pixels = &generatedGround->pixels[0];
+	}
+	buildAtlas(std::vector<AtlasSource>(sources, sources + ROOM_TILES), ROOM_ATLAS_TILE, ROOM_ATLAS_GUTTER, roomAtlas);
+
+	/* The atlas has its own copy, so the generated tiles go when the handles above do */
+	clearProcTextureCache();
+}
+
+bool loadAtlasTexture(Texture& texture, const char *name, void *atlas)
+{
+	TextureAtlas *textureAtlas = (TextureAtlas *)atlas;
+	if(textureAtlas->chain.levels.empty())
+		return false;
+
+	glEnable(GL_TEXTURE);
+
+	glBindTexture(GL_TEXTURE_2D, texture.name);
 
 	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_DECAL);
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	/* Nothing is drawn up to the atlas' edges, and wrapping is done by addAtlasQuad */
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, 3, CHECKER_TEX_COLS, CHECKER_TEX_ROWS, 0, GL_RGB, GL_UNSIGNED_BYTE, checkerTexData);
-//   glTexImage2D(GL_TEXTURE_2D, 0, 3, IMAGE_COLS, IMAGE_ROWS, 0, GL_RGB,  GL_UNSIGNED_BYTE, imageData);  // Create texture from image data
+	/* Take the pixels, leaving the regions for setWalls */
+	MipChain *chain = new MipChain;
+	chain->channels = textureAtlas->chain.channels;
+	chain->levels.swap(textureAtlas->chain.levels);
+	chain->pixels.swap(textureAtlas->chain.pixels);
+	uploadMipLevels(texture, &chain->pixels[0], &chain->levels[0], (int)chain->levels.size(), chain->channels, [chain]()
+	{
+		delete chain;
+	});
 
 	glDisable(GL_TEXTURE);
+	return true;
 }
 
 void nextLevel(void)
 {
-	if(currentLevel < NO_LEVELS - 1)
+	printGroundStreamStats();
+
+	/* The prefetch job may still be building the next level's rings, whose size the stats read */
+	waitForPrefetch();
+	printLevelCacheStats();
+	if(currentLevel < getLevelCount() - 1)
 	{
 		currentLevel++;
 		newGame(autopilot, FALSE);
@@ -1736,15 +2071,39 @@ void nextLevel(void)
 	}
 }
 
-void setWalls(void)
+void setWalls(int buildRoom)
+{
+	roomWalls walls;
+	placeWalls(&levelParams, currentDiff, &walls);
+
+	memcpy(frontWallVertices, walls.vertices[frontWall], sizeof(frontWallVertices));
+	memcpy(backWallVertices, walls.vertices[backWall], sizeof(backWallVertices));
+	memcpy(leftWallVertices, walls.vertices[leftWall], sizeof(leftWallVertices));
+	memcpy(rightWallVertices, walls.vertices[rightWall], sizeof(rightWallVertices));
+	memcpy(ceilingVertices, walls.vertices[ceilingWall], sizeof(ceilingVertices));
+	memcpy(floorVertices, walls.vertices[floorWall], sizeof(floorVertices));
+	memcpy(frontWallTexCoords, walls.texCoords[frontWall], sizeof(frontWallTexCoords));
+	memcpy(backWallTexCoords, walls.texCoords[backWall], sizeof(backWallTexCoords));
+	memcpy(leftWallTexCoords, walls.texCoords[leftWall], sizeof(leftWallTexCoords));
+	memcpy(rightWallTexCoords, walls.texCoords[rightWall], sizeof(rightWallTexCoords));
+	memcpy(ceilingTexCoords, walls.texCoords[ceilingWall], sizeof(ceilingTexCoords));
+	memcpy(floorTexCoords, walls.texCoords[floorWall], sizeof(floorTexCoords));
+	glEnableClientState(GL_VERTEX_ARRAY);
+
+	if(buildRoom)
+		buildRoomTriangles(&walls, !groundStreamOpen(), &roomTriangles);
+}
+
+/* Touches nothing but walls, so the prefetch job can place the next level's walls while this one is flown */
+void placeWalls(const mapParams *params, int diff, roomWalls *walls)
 {
 		/* Set up parameters for the walls */
-	GLfloat midpoint = (GLfloat)(levelParams[currentLevel].cols -1)/2.0;
-	GLfloat xUprBnd = (GLfloat)(dirSclr[currentDiff].x* (levelParams[currentLevel].rows + dirMargin.x));
-	GLfloat xLwrBnd = -dirSclr[currentDiff].x*dirMargin.x;
-	GLfloat yUprBnd = ((GLfloat)levelParams[currentLevel].height + dirSclr[currentDiff].y*dirMargin.y );
-	GLfloat yLwrBnd = -(torusOuterRad[currentDiff] + dirMargin.y*dirSclr[currentDiff].y);
-	GLfloat zUprBnd = dirSclr[currentDiff].z*(dirMargin.z + midpoint) + torusOuterRad[currentDiff];
+	GLfloat midpoint = (GLfloat)(params->cols -1)/2.0;
+	GLfloat xUprBnd = (GLfloat)(dirSclr[diff].x* (params->rows + dirMargin.x));
+	GLfloat xLwrBnd = -dirSclr[diff].x*dirMargin.x;
+	GLfloat yUprBnd = ((GLfloat)params->height + dirSclr[diff].y*dirMargin.y );
+	GLfloat yLwrBnd = -(torusOuterRad[diff] + dirMargin.y*dirSclr[diff].y);
+	GLfloat zUprBnd = dirSclr[diff].z*(dirMargin.z + midpoint) + torusOuterRad[diff];
 	GLfloat zLwrBnd = -zUprBnd;
 
 	GLfloat sideHeight = wallTexSize;
@@ -1757,113 +2116,226 @@ void setWalls(void)
 	GLfloat endLength = ( (zUprBnd - zLwrBnd)/(yUprBnd - yLwrBnd) )*endTexSize;
 
 	/* Set co-ordinate arrays for walls */
-	glEnableClientState(GL_VERTEX_ARRAY);
-	setCoordArray(backWallVertices, xUprBnd, yLwrBnd, zLwrBnd,
+	setCoordArray(walls->vertices[backWall], xUprBnd, yLwrBnd, zLwrBnd,
 		                            xUprBnd, yLwrBnd, zUprBnd,
 		                            xUprBnd, yUprBnd, zUprBnd,
 		                            xUprBnd, yUprBnd, zLwrBnd);
 
-	setTexArray(backWallTexCoords, 0.0, 0.0,
+	setTexArray(walls->texCoords[backWall], 0.0, 0.0,
 		                           endLength, 0.0,
 		                           endLength, endHeight,
 		                           0.0, endHeight);
 
-	setCoordArray(frontWallVertices, xLwrBnd, yLwrBnd, zLwrBnd,
+	setCoordArray(walls->vertices[frontWall], xLwrBnd, yLwrBnd, zLwrBnd,
 		                             xLwrBnd, yLwrBnd, zUprBnd,
 		                             xLwrBnd, yUprBnd, zUprBnd,
 		                             xLwrBnd, yUprBnd, zLwrBnd);
 
-	setCoordArray(leftWallVertices, xLwrBnd, yLwrBnd, zLwrBnd,
+	setTexArray(walls->texCoords[frontWall], 0.0, 0.0,
+		                            1.0, 0.0,
+		                            1.0, 1.0,
+		                            0.0, 1.0);
+
+	setCoordArray(walls->vertices[leftWall], xLwrBnd, yLwrBnd, zLwrBnd,
 		                            xLwrBnd, yUprBnd, zLwrBnd,
 		                            xUprBnd, yUprBnd, zLwrBnd,
 		                            xUprBnd, yLwrBnd, zLwrBnd);
 
-	setTexArray(leftWallTexCoords, 0.0, 0.0,
+	setTexArray(walls->texCoords[leftWall], 0.0, 0.0,
 		                           0.0, sideHeight,
 		                           sideLength, sideHeight,
 		                           sideLength, 0.0);
 
-	setCoordArray(rightWallVertices, xLwrBnd, yLwrBnd, zUprBnd,
+	setCoordArray(walls->vertices[rightWall], xLwrBnd, yLwrBnd, zUprBnd,
 		                            xLwrBnd, yUprBnd, zUprBnd,
 		                            xUprBnd, yUprBnd, zUprBnd,
 		                            xUprBnd, yLwrBnd, zUprBnd);
 
-	setTexArray(rightWallTexCoords, 0.0, 0.0,
+	setTexArray(walls->texCoords[rightWall], 0.0, 0.0,
 		                           0.0, sideHeight,
 		                           sideLength, sideHeight,
 		                           sideLength, 0.0);
 
-	setCoordArray(ceilingVertices, xLwrBnd, yUprBnd, zLwrBnd,
+	setCoordArray(walls->vertices[ceilingWall], xLwrBnd, yUprBnd, zLwrBnd,
 		                           xLwrBnd, yUprBnd, zUprBnd,
 		                           xUprBnd, yUprBnd, zUprBnd,
 		                           xUprBnd, yUprBnd, zLwrBnd);
 
-	setTexArray(ceilingTexCoords, 0.0, 0.0,
+	setTexArray(walls->texCoords[ceilingWall], 0.0, 0.0,
 		                          floorWidth, 0.0,
 		                          floorWidth, floorLength,
 		                          0.0, floorLength);
 
-	setCoordArray(floorVertices, xLwrBnd, yLwrBnd, zLwrBnd,
+	setCoordArray(walls->vertices[floorWall], xLwrBnd, yLwrBnd, zLwrBnd,
 		                         xLwrBnd, yLwrBnd, zUprBnd,
 		                         xUprBnd, yLwrBnd, zUprBnd,
 		                         xUprBnd, yLwrBnd, zLwrBnd);
 
-	setTexArray(floorTexCoords, 0.0, 0.0,
+	setTexArray(walls->texCoords[floorWall], 0.0, 0.0,
 		                        floorWidth, 0.0,
 		                        floorWidth, floorLength,
 		                        0.0, floorLength);
+}
 
+/* Cuts the walls up where their textures repeat, with co-ordinates into the atlas (the front wall's tile is plain
+   green). Without withFloor the floor is left out, for the streamed ground to draw */
+void buildRoomTriangles(const roomWalls *walls, int withFloor, std::vector<GLfloat> *triangles)
+{
+	triangles->clear();
+	addAtlasQuad(walls->vertices[frontWall], walls->texCoords[frontWall], roomAtlas.regions[frontTile], *triangles);
+	addAtlasQuad(walls->vertices[backWall], walls->texCoords[backWall], roomAtlas.regions[checkerTile], *triangles);
+	addAtlasQuad(walls->vertices[rightWall], walls->texCoords[rightWall], roomAtlas.regions[skyTile], *triangles);
+	addAtlasQuad(walls->vertices[leftWall], walls->texCoords[leftWall], roomAtlas.regions[skyTile], *triangles);
+	addAtlasQuad(walls->vertices[ceilingWall], walls->texCoords[ceilingWall], roomAtlas.regions[skyTile], *triangles);
+	if(withFloor)
+		addAtlasQuad(walls->vertices[floorWall], walls->texCoords[floorWall], roomAtlas.regions[groundTile], *triangles);
 }
 
 
 void moveRings(void)
 {
-	GLfloat zLimit = (GLfloat)(levelParams[currentLevel].cols * dirSclr[currentDiff].z)/2.0;
-	GLfloat yLimit = (GLfloat)(levelParams[currentLevel].height);
+	GLfloat zLimit = (GLfloat)(levelParams.cols * dirSclr[currentDiff].z)/2.0;
+	GLfloat yLimit = (GLfloat)(levelParams.height);
+
+	/* Only the rings still ahead move */
+	RingLimits limits;
+	limits.minY = 0 + torusOuterRad[currentDiff];
+	limits.maxY = yLimit - torusOuterRad[currentDiff];
+	limits.minZ = -zLimit + torusOuterRad[currentDiff];
+	limits.maxZ = zLimit - torusOuterRad[currentDiff];
+	limits.step = ringInc;
+	limits.spin = ringSpinInc;
+	if(endlessCourse)
+	{
+		moveCourseBack();
+		streamCourse();
+	} else {
+		streamRings();
+	}
+	stepRings(rings, currentRing, limits);
+}
 
-	ringList *nextToProc;
-	for(nextToProc = currentRing; nextToProc != NULL; nextToProc = nextToProc->next )
+/* Makes up rows of the endless course up to RING_STREAM_DISTANCE past the next ring. When a row's ring has
+   no room left in its group, the rings already flown through are recycled to make some */
+void streamCourse(void)
+{
+	LevelCell cells[COURSE_COLS];
+	GLfloat midpoint = (GLfloat)(COURSE_COLS - 1)/2.0;
+	for(;;)
 	{
-		if(nextToProc->movement == still)
-			continue;
-		else if(nextToProc->movement == horizontal)
+		/* Always keep the ring after the next one, which the autopilot heads for */
+		if(currentRing + 1 < rings.count && dirSclr[currentDiff].x*(course.row - courseRowOffset + 1) > ringPosition(currentRing).x + RING_STREAM_DISTANCE)
+			break;
+
+		CourseGenerator before = course;
+		int row = nextCourseRow(course, cells);
+		if(!courseRowFits(cells))
+			recyclePassedRings();
+		if(!courseRowFits(cells))
 		{
-			if(nextToProc->direction == TRUE)
+			/* Made again, the same, once some rings have been passed */
+			course = before;
+			break;
+		}
+
+		int col;
+		for(col=0; col < COURSE_COLS; col++)
+		{
+			if(cells[col].height != 0)
 			{
-				(nextToProc->position.z)+= ringInc;
+				vector3d ringPos;
+				ringPos.x = (GLfloat)(dirSclr[currentDiff].x*(row - courseRowOffset + 1));
+				ringPos.y = (GLfloat)(dirSclr[currentDiff].y*cells[col].height)/(GLfloat)3.0;
+				ringPos.z = dirSclr[currentDiff].z*(col - midpoint);
+				storeRing(&rings, ringPos, cells[col].movement);
+			}
+		}
+	}
+}
 
-				if(nextToProc->position.z > zLimit - torusOuterRad[currentDiff])
-					nextToProc->direction = FALSE;
-			} else {
-				(nextToProc->position.z)-= ringInc;
+/* Drops the rings already flown through, numbering the rest from 0 and freeing their slots for new ones */
+void recyclePassedRings(void)
+{
+	if(currentRing == 0)
+		return;
 
-				if(nextToProc->position.z < -zLimit + torusOuterRad[currentDiff])
-					nextToProc->direction = TRUE;
-			}
-		} else if(nextToProc->movement == vertical) {
-			if(nextToProc->direction == TRUE)
-			{
-				(nextToProc->position.y)+= ringInc;
+	recycleRings(rings, currentRing);
+	lastCollision = lastCollision >= currentRing ? lastCollision - currentRing : -1;
+	lastInside = lastInside >= currentRing ? lastInside - currentRing : -1;
+	currentRing = 0;
+}
 
-				if(nextToProc->position.y > yLimit - torusOuterRad[currentDiff])
-					nextToProc->direction = FALSE;
-			} else {
-				(nextToProc->position.y)-= ringInc;
+/* Whether every ring of a course row has room in its group, so adding them keeps rings grouped */
+int courseRowFits(const LevelCell *cells)
+{
+	int col, needed[RING_MOVEMENTS] = {0};
+	for(col=0; col < COURSE_COLS; col++)
+		if(cells[col].height != 0)
+			needed[getRingMovement(cells[col].movement)]++;
+	int movement;
+	for(movement=0; movement < RING_MOVEMENTS; movement++)
+		if(needed[movement] > getRingRoom(rings, (enum ringMovement)movement))
+			return FALSE;
+	return TRUE;
+}
 
-				if(nextToProc->position.y < 0 + torusOuterRad[currentDiff])
-					nextToProc->direction = TRUE;
-			}
-		} else if(nextToProc->movement == spinClock) {
-			nextToProc->angle += ringSpinInc;
+/* Moves the plane and the rings back along the room once the plane is far enough along, so the room never
+   ends and positions don't lose precision over hours of flight */
+void moveCourseBack(void)
+{
+	GLfloat shift = dirSclr[currentDiff].x*COURSE_MOVE_BACK_ROWS;
+	if(pos.x < 2*shift)
+		return;
 
-			if(nextToProc->angle >= 360.0)
-				nextToProc->angle -= 360.0;
-		} else {
-			nextToProc->angle -= ringSpinInc;
+	pos.x -= shift;
+	int slot;
+	for(slot=0; slot < rings.slotsUsed; slot++)
+		rings.x[slot] -= shift;
+	courseRowOffset += COURSE_MOVE_BACK_ROWS;
+}
+
+/* Adds the rings of the current level's pack up to RING_STREAM_DISTANCE past the next ring, so chunks
+   further on aren't read until the plane gets near them. Room is kept for each chunk in its rings' groups,
+   recycling the rings already flown through first, so adding them never ungroups rings. Does nothing for
+   a level read from text */
+void streamRings(void)
+{
+	if(currentLevelData == NULL || currentLevelData->pack.chunks == NULL)
+		return;
+
+	const LevelPack& pack = currentLevelData->pack;
+	GLfloat midpoint = (GLfloat)(pack.cols - 1)/2.0;
+	while(nextChunk < pack.chunkCount)
+	{
+		/* Always keep the ring after the next one, which the autopilot heads for */
+		int firstRow = getChunkRow(pack, nextChunk);
+		if(currentRing + 1 < rings.count && dirSclr[currentDiff].x*(firstRow + 1) > ringPosition(currentRing).x + RING_STREAM_DISTANCE)
+			break;
+
+		int count, i, movement;
+		const LevelPackRing* chunkRings = getChunkRings(pack, nextChunk, count);
+		int needed[RING_MOVEMENTS] = {0};
+		for(i=0; i < count; i++)
+			needed[getRingMovement(chunkRings[i].movement)]++;
+		for(movement=0; movement < RING_MOVEMENTS; movement++)
+		{
+			if(needed[movement] > getRingRoom(rings, (enum ringMovement)movement))
+			{
+				recyclePassedRings();
+				reserveRingRoom(rings, needed);
+				break;
+			}
+		}
 
-			if(nextToProc->angle <= -360.0)
-				nextToProc->angle += 360.0;
+		for(i=0; i < count; i++)
+		{
+			vector3d ringPos;
+			ringPos.x = (GLfloat)(dirSclr[currentDiff].x*(firstRow + chunkRings[i].row + 1));
+			ringPos.y = (GLfloat)(dirSclr[currentDiff].y*chunkRings[i].height)/(GLfloat)3.0;
+			ringPos.z = dirSclr[currentDiff].z*(chunkRings[i].col - midpoint);
+			storeRing(&rings, ringPos, chunkRings[i].movement);
 		}
+		nextChunk++;
 	}
 }
 
@@ -1992,25 +2464,19 @@ void stopVibrating(int portNo)
 void vibrateController(int leftSpeed, int rightSpeed, int duration, int portNo);
 void stopVibrating(int portNo);
 
-void mapsToLinkedLists(void)
-{
-	int i;
-	for(i=0; i< NO_LEVELS; i++)
-	{
-		freeLinkedList(initialRing[i]);
-		initialRing[i] = arrayToLinkedList(posMaps[i], stateMaps[i], &levelParams[i]);
-	}
-}
-
-void freeLinkedList(ringList *list)
+/* The rings a game on level at diff starts with, and the height of the highest */
+const RingStore *getLevelRings(CachedLevel *level, int diff, int *height)
 {
-	ringList *temp;
-	while(list != NULL)
+	assert(diff >= 0 && diff < LEVEL_RING_LAYOUTS);
+	if(level->rings[diff] == NULL)
 	{
-		temp = list;
-		list = list->next;
-		free(temp);
+		/* In the level's arena along with its grid, so they're dropped together */
+		RingStore *levelRings = new(arenaAlloc(level->arena, sizeof(RingStore))) RingStore(&level->arena);
+		gridToRings(&level->grid, diff, levelRings, &level->heights[diff]);
+		level->rings[diff] = levelRings;
 	}
+	*height = level->heights[diff];
+	return level->rings[diff];
 }
 
 void toggleTurbo(int x)
@@ -6,8 +6,20 @@
  */
 
 #include "mesh.h"
+#include "meshbuffer.h"
+#include "meshlod.h"
+#include "meshopt.h"
+#include "platform.h"
+#include <stdio.h>
+#include <string.h>
+#include <thread>
 
-void loadMesh(Mesh& myMesh,std::string filename)
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MESH_SSE2
+#endif
+
+void loadMeshStream(Mesh& myMesh,std::string filename)
 {
 
 	/**
@@ -69,24 +81,598 @@ void loadMesh(Mesh& myMesh,std::string filename)
   
 	// Explicit closing of the file
 	filestream.close();
+
+	computeMeshBounds(myMesh);
+}
+namespace {
+	//Number of each kind of OBJ record, also used as running write positions while parsing
+	struct MeshCounts{
+		size_t faces;
+		size_t vertices;
+		size_t normals;
+		size_t tex_coords;
+	};
+
+	enum ObjLineType{
+		OBJ_OTHER,
+		OBJ_VERTEX,
+		OBJ_TEXTURE,
+		OBJ_NORMAL,
+		OBJ_FACE
+	};
+
+	const double powersOfTen[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+	                              1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+	inline bool isBlank(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline bool isDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	inline const char* skipBlanks(const char* p, const char* end)
+	{
+		while(p < end && isBlank(*p))
+			p++;
+		return p;
+	}
+
+	//Returns a pointer to the start of the next line
+	inline const char* skipLine(const char* p, const char* end)
+	{
+		while(p < end && *p != '\n')
+			p++;
+		return p < end ? p + 1 : end;
+	}
+
+	//Classifies the line starting at p and moves p past the record keyword
+	inline ObjLineType lineType(const char*& p, const char* end)
+	{
+		p = skipBlanks(p, end);
+		if(end - p < 2)
+			return OBJ_OTHER;
+
+		if(p[0] == 'v')
+		{
+			if(isBlank(p[1]))
+			{
+				p += 1;
+				return OBJ_VERTEX;
+			}
+			if(end - p >= 3 && isBlank(p[2]))
+			{
+				if(p[1] == 't')
+				{
+					p += 2;
+					return OBJ_TEXTURE;
+				}
+				if(p[1] == 'n')
+				{
+					p += 2;
+					return OBJ_NORMAL;
+				}
+			}
+		} else if(p[0] == 'f' && isBlank(p[1])) {
+			p += 1;
+			return OBJ_FACE;
+		}
+		return OBJ_OTHER;
+	}
+
+	//Reads a signed decimal integer
+	const char* parseInt(const char* p, const char* end, int& value)
+	{
+		int sign = 1;
+		if(p < end && (*p == '-' || *p == '+'))
+		{
+			if(*p == '-')
+				sign = -1;
+			p++;
+		}
+
+		int result = 0;
+		while(p < end && isDigit(*p))
+		{
+			result = result*10 + (*p - '0');
+			p++;
+		}
+		value = sign*result;
+		return p;
+	}
+
+	//Reads a float in plain or scientific notation. Up to 19 significant digits
+	//are accumulated exactly, then scaled once by a power of ten.
+	const char* parseFloat(const char* p, const char* end, float& value)
+	{
+		p = skipBlanks(p, end);
+
+		bool negative = false;
+		if(p < end && (*p == '-' || *p == '+'))
+		{
+			negative = (*p == '-');
+			p++;
+		}
+
+		unsigned long long mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		while(p < end && isDigit(*p))
+		{
+			if(digits < 19)
+			{
+				mantissa = mantissa*10 + (*p - '0');
+				if(mantissa != 0)
+					digits++;
+			} else {
+				exponent++;
+			}
+			p++;
+		}
+		if(p < end && *p == '.')
+		{
+			p++;
+			while(p < end && isDigit(*p))
+			{
+				if(digits < 19)
+				{
+					mantissa = mantissa*10 + (*p - '0');
+					if(mantissa != 0)
+						digits++;
+					exponent--;
+				}
+				p++;
+			}
+		}
+		if(p < end && (*p == 'e' || *p == 'E'))
+		{
+			int e;
+			p = parseInt(p + 1, end, e);
+			exponent += e;
+		}
+
+		double result = (double)mantissa;
+		if(exponent < 0)
+		{
+			while(exponent < -22)
+			{
+				result /= 1e22;
+				exponent += 22;
+			}
+			result /= powersOfTen[-exponent];
+		} else {
+			while(exponent > 22)
+			{
+				result *= 1e22;
+				exponent -= 22;
+			}
+			result *= powersOfTen[exponent];
+		}
+		value = (float)(negative ? -result : result);
+		return p;
+	}
+
+	//Converts a 1-based (or negative, relative) OBJ index to a 0-based index
+	inline int objIndex(int index, size_t count)
+	{
+		return index < 0 ? (int)count + index : index - 1;
+	}
+
+	//Reads one "v/vt/vn" corner of a face. Missing vt or vn entries are left as -1
+	const char* parseCorner(const char* p, const char* end, Face& face, int corner, const MeshCounts& at)
+	{
+		int index;
+		p = parseInt(skipBlanks(p, end), end, index);
+		face.position_idx[corner] = objIndex(index, at.vertices);
+		face.texture_idx[corner] = -1;
+		face.normal_idx[corner] = -1;
+
+		if(p < end && *p == '/')
+		{
+			p++;
+			if(p < end && *p != '/')
+			{
+				p = parseInt(p, end, index);
+				face.texture_idx[corner] = objIndex(index, at.tex_coords);
+			}
+			if(p < end && *p == '/')
+			{
+				p = parseInt(p + 1, end, index);
+				face.normal_idx[corner] = objIndex(index, at.normals);
+			}
+		}
+		return p;
+	}
+
+	//Counts the records in [p, end) so every array can be allocated exactly once
+	MeshCounts countMeshLines(const char* p, const char* end)
+	{
+		MeshCounts counts = {0, 0, 0, 0};
+		while(p < end)
+		{
+			switch(lineType(p, end))
+			{
+				case OBJ_VERTEX:  counts.vertices++;   break;
+				case OBJ_TEXTURE: counts.tex_coords++; break;
+				case OBJ_NORMAL:  counts.normals++;    break;
+				case OBJ_FACE:    counts.faces++;      break;
+				default: break;
+			}
+			p = skipLine(p, end);
+		}
+		return counts;
+	}
+
+	//Parses the records in [p, end) into the mesh arrays, starting at the positions in "at"
+	void parseMeshLines(const char* p, const char* end, Mesh& mesh, MeshCounts at)
+	{
+		while(p < end)
+		{
+			switch(lineType(p, end))
+			{
+				case OBJ_VERTEX:
+				{
+					Vector3f& position = mesh.vertices[at.vertices++];
+					p = parseFloat(p, end, position.x);
+					p = parseFloat(p, end, position.y);
+					p = parseFloat(p, end, position.z);
+					break;
+				}
+				case OBJ_TEXTURE:
+				{
+					Vector2f& texture = mesh.tex_coords[at.tex_coords++];
+					p = parseFloat(p, end, texture.x);
+					p = parseFloat(p, end, texture.y);
+					break;
+				}
+				case OBJ_NORMAL:
+				{
+					Vector3f& normal = mesh.vertex_normals[at.normals++];
+					p = parseFloat(p, end, normal.x);
+					p = parseFloat(p, end, normal.y);
+					p = parseFloat(p, end, normal.z);
+					break;
+				}
+				case OBJ_FACE:
+				{
+					Face& face = mesh.faces[at.faces++];
+					for(int i = 0; i < 3; ++i)
+						p = parseCorner(p, end, face, i, at);
+					break;
+				}
+				default:
+					break;
+			}
+			p = skipLine(p, end);
+		}
+	}
 }
-void drawMesh(Mesh mesh)
+
+namespace {
+	//Don't bother splitting the file into pieces smaller than this
+	const size_t minMeshChunkBytes = 256*1024;
+
+	//One newline-aligned slice of the obj, parsed by its own thread
+	struct MeshChunk{
+		const char* begin;
+		const char* end;
+		MeshCounts counts; // Records in this chunk
+		MeshCounts start;  // Records in all earlier chunks, i.e. where this chunk writes
+	};
+
+	void countMeshChunk(MeshChunk* chunk)
+	{
+		chunk->counts = countMeshLines(chunk->begin, chunk->end);
+	}
+
+	void parseMeshChunk(MeshChunk* chunk, Mesh* mesh)
+	{
+		parseMeshLines(chunk->begin, chunk->end, *mesh, chunk->start);
+	}
+
+	//Splits [begin, end) into at most n chunks, each ending just after a newline
+	std::vector<MeshChunk> splitMeshChunks(const char* begin, const char* end, int n)
+	{
+		size_t size = end - begin;
+		if((size_t)n > size/minMeshChunkBytes)
+			n = (int)(size/minMeshChunkBytes);
+		if(n < 1)
+			n = 1;
+
+		std::vector<MeshChunk> chunks;
+		const char* chunkBegin = begin;
+		for(int i = 1; i <= n && chunkBegin < end; i++)
+		{
+			const char* chunkEnd = (i == n) ? end : skipLine(begin + size*i/n - 1, end);
+			if(chunkEnd <= chunkBegin)
+				continue;
+
+			MeshChunk chunk;
+			chunk.begin = chunkBegin;
+			chunk.end = chunkEnd;
+			chunks.push_back(chunk);
+			chunkBegin = chunkEnd;
+		}
+		return chunks;
+	}
+}
+
+void loadMeshMapped(Mesh& myMesh, std::string filename, int threads)
 {
+	MappedFile file;
+	if(!openMappedFile(file, filename.c_str()))
+	{
+		printf("Could not open mesh %s\n", filename.c_str());
+		return;
+	}
+
+	double startTime = getSeconds();
+	std::vector<MeshChunk> chunks = splitMeshChunks(file.data, file.data + file.size, threads);
+	std::vector<std::thread> workers;
+	size_t i;
+
+	/* First pass: count records in every chunk so each array is allocated once */
+	for(i = 1; i < chunks.size(); i++)
+		workers.push_back(std::thread(countMeshChunk, &chunks[i]));
+	if(!chunks.empty())
+		countMeshChunk(&chunks[0]);
+	for(i = 0; i < workers.size(); i++)
+		workers[i].join();
+	workers.clear();
+
+	/* Prefix sum of the counts gives every chunk its write position. OBJ indices
+	   are global, so the same totals also resolve negative (relative) indices */
+	MeshCounts counts = {0, 0, 0, 0};
+	for(i = 0; i < chunks.size(); i++)
+	{
+		chunks[i].start = counts;
+		counts.faces += chunks[i].counts.faces;
+		counts.vertices += chunks[i].counts.vertices;
+		counts.normals += chunks[i].counts.normals;
+		counts.tex_coords += chunks[i].counts.tex_coords;
+	}
+	myMesh.faces.resize(counts.faces);
+	myMesh.vertices.resize(counts.vertices);
+	myMesh.vertex_normals.resize(counts.normals);
+	myMesh.tex_coords.resize(counts.tex_coords);
+
+	/* Second pass: every chunk parses straight out of the mapping into its own slice of the arrays */
+	for(i = 1; i < chunks.size(); i++)
+		workers.push_back(std::thread(parseMeshChunk, &chunks[i], &myMesh));
+	if(!chunks.empty())
+		parseMeshChunk(&chunks[0], &myMesh);
+	for(i = 0; i < workers.size(); i++)
+		workers[i].join();
+
+	double elapsed = getSeconds() - startTime;
+	if(elapsed <= 0)
+		elapsed = 1e-9;
+
+	printf("Loaded Mesh %s consisting of %d faces, %d positions, %d normals and %d texture coordinates in %.2f ms on %d threads (%.1f MB/s, %.0f faces/s)\n",
+		filename.c_str(), (int)counts.faces, (int)counts.vertices, (int)counts.normals, (int)counts.tex_coords,
+		elapsed*1000.0, (int)chunks.size(), file.size/(elapsed*1024.0*1024.0), counts.faces/elapsed);
+
+	closeMappedFile(file);
+
+	computeMeshBounds(myMesh);
+}
+
+namespace {
+	const char meshCacheMagic[8] = {'M','E','S','H','B','I','N','\0'};
+	const unsigned int meshCacheVersion = 4; // 2: vertex cache order, 3: detail levels, 4: bounds no longer clamped to the origin
+
+	//Header of a .meshbin sidecar. The arrays follow it in the order faces,
+	//vertices, vertex_normals, tex_coords, each stored exactly as in memory,
+	//then the index list of each reduced detail level.
+	struct MeshCacheHeader{
+		char magic[8];
+		unsigned int version;
+		unsigned int headerSize;
+		unsigned long long sourceSize;  // Size of the obj the cache was built from
+		unsigned long long sourceTime;  // Modification time of that obj
+		unsigned int faces;
+		unsigned int vertices;
+		unsigned int normals;
+		unsigned int tex_coords;
+		Vector3f centroid;
+		Vector3f bounds_min;
+		Vector3f bounds_max;
+		unsigned int lods; // Reduced detail levels stored
+		unsigned int lod_indices[MAX_MESH_LODS - 1];
+	};
+
+	size_t lodIndexTotal(const MeshCacheHeader& header)
+	{
+		size_t total = 0;
+		for(unsigned int i = 0; i < header.lods && i < MAX_MESH_LODS - 1; i++)
+			total += header.lod_indices[i];
+		return total;
+	}
+
+	size_t meshCacheSize(const MeshCacheHeader& header)
+	{
+		return sizeof(MeshCacheHeader)
+			+ header.faces*sizeof(Face)
+			+ header.vertices*sizeof(Vector3f)
+			+ header.normals*sizeof(Vector3f)
+			+ header.tex_coords*sizeof(Vector2f)
+			+ lodIndexTotal(header)*sizeof(unsigned int);
+	}
+
+	//Fills the mesh from a cache file. Returns false if the cache is missing,
+	//from another version or built from a different obj
+	bool readMeshCache(Mesh& mesh, const std::string& cacheName, unsigned long long sourceSize, unsigned long long sourceTime)
+	{
+		MappedFile file;
+		if(!openMappedFile(file, cacheName.c_str()))
+			return false;
+
+		MeshCacheHeader header;
+		bool valid = file.size >= sizeof(MeshCacheHeader);
+		if(valid)
+		{
+			memcpy(&header, file.data, sizeof(MeshCacheHeader));
+			valid = memcmp(header.magic, meshCacheMagic, sizeof(meshCacheMagic)) == 0
+				&& header.version == meshCacheVersion
+				&& header.headerSize == sizeof(MeshCacheHeader)
+				&& header.sourceSize == sourceSize
+				&& header.sourceTime == sourceTime
+				&& header.lods < MAX_MESH_LODS
+				&& meshCacheSize(header) == file.size;
+		}
+		if(!valid)
+		{
+			closeMappedFile(file);
+			return false;
+		}
+
+		/* Mesh owns its arrays, so this is one bulk copy per array - nothing is parsed */
+		const char* p = file.data + sizeof(MeshCacheHeader);
+		const Face* faces = (const Face*)p;
+		mesh.faces.assign(faces, faces + header.faces);
+		p += header.faces*sizeof(Face);
+
+		const Vector3f* vertices = (const Vector3f*)p;
+		mesh.vertices.assign(vertices, vertices + header.vertices);
+		p += header.vertices*sizeof(Vector3f);
+
+		const Vector3f* normals = (const Vector3f*)p;
+		mesh.vertex_normals.assign(normals, normals + header.normals);
+		p += header.normals*sizeof(Vector3f);
+
+		const Vector2f* tex_coords = (const Vector2f*)p;
+		mesh.tex_coords.assign(tex_coords, tex_coords + header.tex_coords);
+		p += header.tex_coords*sizeof(Vector2f);
+
+		mesh.lod_indices.resize(header.lods);
+		for(unsigned int i = 0; i < header.lods; i++)
+		{
+			const unsigned int* indices = (const unsigned int*)p;
+			mesh.lod_indices[i].assign(indices, indices + header.lod_indices[i]);
+			p += header.lod_indices[i]*sizeof(unsigned int);
+		}
+
+		mesh.centroid = header.centroid;
+		mesh.bounds_min = header.bounds_min;
+		mesh.bounds_max = header.bounds_max;
+
+		closeMappedFile(file);
+		return true;
+	}
+
+	void writeArray(FILE* filePtr, const void* data, size_t bytes, bool& ok)
+	{
+		if(ok && bytes > 0 && fwrite(data, 1, bytes, filePtr) != bytes)
+			ok = false;
+	}
+
+	void writeMeshCache(const Mesh& mesh, const std::string& cacheName, unsigned long long sourceSize, unsigned long long sourceTime)
+	{
+		FILE* filePtr = fopen(cacheName.c_str(), "wb");
+		if(filePtr == NULL)
+		{
+			printf("Could not write mesh cache %s\n", cacheName.c_str());
+			return;
+		}
+
+		MeshCacheHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, meshCacheMagic, sizeof(meshCacheMagic));
+		header.version = meshCacheVersion;
+		header.headerSize = sizeof(MeshCacheHeader);
+		header.sourceSize = sourceSize;
+		header.sourceTime = sourceTime;
+		header.faces = (unsigned int)mesh.faces.size();
+		header.vertices = (unsigned int)mesh.vertices.size();
+		header.normals = (unsigned int)mesh.vertex_normals.size();
+		header.tex_coords = (unsigned int)mesh.tex_coords.size();
+		header.centroid = mesh.centroid;
+		header.bounds_min = mesh.bounds_min;
+		header.bounds_max = mesh.bounds_max;
+		header.lods = (unsigned int)mesh.lod_indices.size();
+		for(unsigned int i = 0; i < header.lods; i++)
+			header.lod_indices[i] = (unsigned int)mesh.lod_indices[i].size();
+
+		bool ok = true;
+		writeArray(filePtr, &header, sizeof(header), ok);
+		writeArray(filePtr, mesh.faces.empty() ? NULL : &mesh.faces[0], mesh.faces.size()*sizeof(Face), ok);
+		writeArray(filePtr, mesh.vertices.empty() ? NULL : &mesh.vertices[0], mesh.vertices.size()*sizeof(Vector3f), ok);
+		writeArray(filePtr, mesh.vertex_normals.empty() ? NULL : &mesh.vertex_normals[0], mesh.vertex_normals.size()*sizeof(Vector3f), ok);
+		writeArray(filePtr, mesh.tex_coords.empty() ? NULL : &mesh.tex_coords[0], mesh.tex_coords.size()*sizeof(Vector2f), ok);
+		for(unsigned int i = 0; i < header.lods; i++)
+			writeArray(filePtr, mesh.lod_indices[i].empty() ? NULL : &mesh.lod_indices[i][0], mesh.lod_indices[i].size()*sizeof(unsigned int), ok);
+
+		if(fclose(filePtr) != 0)
+			ok = false;
+
+		/* A truncated cache would fail the size check anyway, but don't leave it lying around */
+		if(!ok)
+		{
+			printf("Could not write mesh cache %s\n", cacheName.c_str());
+			remove(cacheName.c_str());
+		}
+	}
+}
+
+void loadMesh(Mesh& myMesh,std::string filename, int threads)
+{
+	unsigned long long sourceSize, sourceTime;
+	if(!getFileInfo(filename.c_str(), sourceSize, sourceTime))
+	{
+		printf("Could not open mesh %s\n", filename.c_str());
+		return;
+	}
+
+	std::string cacheName = filename + ".meshbin";
+	double startTime = getSeconds();
+	if(readMeshCache(myMesh, cacheName, sourceSize, sourceTime))
+	{
+		printf("Loaded Mesh %s from %s (%d faces) in %.2f ms\n", filename.c_str(), cacheName.c_str(),
+			(int)myMesh.faces.size(), (getSeconds() - startTime)*1000.0);
+		return;
+	}
+
+	loadMeshMapped(myMesh, filename, threads);
+
+	/* Reorder for the vertex cache and build the detail levels once, here, so the cache stores them */
+	optimizeMesh(myMesh, filename.c_str());
+	buildMeshLods(myMesh, filename.c_str());
+
+	writeMeshCache(myMesh, cacheName, sourceSize, sourceTime);
+}
+
+void drawMesh(const Mesh& mesh, int lod)
+{
+	if(mesh.lod_count > 0)
+	{
+		drawMeshBuffers(mesh, lod);
+		return;
+	}
+
 	// Begin drawing of triangles.
 	glBegin(GL_TRIANGLES);
 
 	// Iterate over each face.
 	for(unsigned int i= 0; i<mesh.faces.size(); i++)
 	{
-		Face face = mesh.faces[i];
+		const Face& face = mesh.faces[i];
 		for(int j= 0; j<3; j++)
 		{
 			Vector3f vpos = mesh.vertices[face.position_idx[j]];
-			Vector3f vnorm = mesh.vertex_normals[face.normal_idx[j]];
-			Vector2f vtex = mesh.tex_coords[face.texture_idx[j]];
 
-			glNormal3f(vnorm.x, vnorm.y, vnorm.z); 
-			glTexCoord2f(vtex.x, vtex.y);//comment this line if not textures are being used
+			if(face.normal_idx[j] >= 0) // loadMeshMapped leaves -1 for corners without a normal
+			{
+				Vector3f vnorm = mesh.vertex_normals[face.normal_idx[j]];
+				glNormal3f(vnorm.x, vnorm.y, vnorm.z); 
+			}
+			if(face.texture_idx[j] >= 0)
+			{
+				Vector2f vtex = mesh.tex_coords[face.texture_idx[j]];
+				glTexCoord2f(vtex.x, vtex.y);//comment this line if not textures are being used
+			}
 			glVertex3f(vpos.x, vpos.y, vpos.z);
 		}
 	}
@@ -94,65 +680,108 @@ void drawMesh(Mesh mesh)
 	glEnd();
 }
 
-Vector3f getCentroid(Mesh& mesh)
+void computeMeshBounds(Mesh& mesh)
 {
-	Vector3f mean;
-	mean.x=0;
-	mean.y=0;
-	mean.z=0;
-	int n=mesh.vertices.size();
-	for(int i=0;i<n;i++)
-	{
-		mean.x+=mesh.vertices[i].x;
-		mean.y+=mesh.vertices[i].y;
-		mean.z+=mesh.vertices[i].z;
-	}
-	mean.x/=n;
-	mean.y/=n;
-	mean.z/=n;
-	return mean;
-}
+	size_t n = mesh.vertices.size();
+	if(n == 0)
+	{
+		mesh.centroid.x = mesh.centroid.y = mesh.centroid.z = 0;
+		mesh.bounds_min = mesh.bounds_max = mesh.centroid;
+		return;
+	}
 
-Vector3f getMax(Mesh&mesh)
-{
-	Vector3f max;
-	max.x=0;
-	max.y=0;
-	max.z=0;
-	int n=mesh.vertices.size();
-	for(int i=0;i<n;i++)
+	const float* v = &mesh.vertices[0].x;
+	float low[3] = {v[0], v[1], v[2]};
+	float high[3] = {v[0], v[1], v[2]};
+	double sum[3] = {0, 0, 0};
+	size_t i = 0;
+
+#ifdef MESH_SSE2
+	/* Four vertices are three registers, (x y z x) (y z x y) (z x y z). Keep
+	   running min/max/sum per register and fold the lanes together at the end.
+	   Sums are kept in doubles as float sums lose too much on big meshes */
+	__m128 lowA = _mm_setr_ps(v[0], v[1], v[2], v[0]);
+	__m128 lowB = _mm_setr_ps(v[1], v[2], v[0], v[1]);
+	__m128 lowC = _mm_setr_ps(v[2], v[0], v[1], v[2]);
+	__m128 highA = lowA, highB = lowB, highC = lowC;
+	__m128d sums[6];
+	for(int j = 0; j < 6; j++)
+		sums[j] = _mm_setzero_pd();
+
+	for(; i + 4 <= n; i += 4)
 	{
-		if(max.x < mesh.vertices[i].x)
-			max.x = mesh.vertices[i].x;
+		__m128 a = _mm_loadu_ps(v + i*3);
+		__m128 b = _mm_loadu_ps(v + i*3 + 4);
+		__m128 c = _mm_loadu_ps(v + i*3 + 8);
 
-		if(max.y < mesh.vertices[i].y)
-			max.y = mesh.vertices[i].y;
+		lowA = _mm_min_ps(lowA, a);
+		lowB = _mm_min_ps(lowB, b);
+		lowC = _mm_min_ps(lowC, c);
+		highA = _mm_max_ps(highA, a);
+		highB = _mm_max_ps(highB, b);
+		highC = _mm_max_ps(highC, c);
 
-		if(max.z < mesh.vertices[i].z)
-			max.z = mesh.vertices[i].z;
+		sums[0] = _mm_add_pd(sums[0], _mm_cvtps_pd(a));
+		sums[1] = _mm_add_pd(sums[1], _mm_cvtps_pd(_mm_movehl_ps(a, a)));
+		sums[2] = _mm_add_pd(sums[2], _mm_cvtps_pd(b));
+		sums[3] = _mm_add_pd(sums[3], _mm_cvtps_pd(_mm_movehl_ps(b, b)));
+		sums[4] = _mm_add_pd(sums[4], _mm_cvtps_pd(c));
+		sums[5] = _mm_add_pd(sums[5], _mm_cvtps_pd(_mm_movehl_ps(c, c)));
 	}
 
-	return max;
-}
+	/* Lane k of the twelve (register k/4) holds axis k%3 */
+	float lanesLow[12], lanesHigh[12];
+	double lanesSum[12];
+	_mm_storeu_ps(lanesLow, lowA);
+	_mm_storeu_ps(lanesLow + 4, lowB);
+	_mm_storeu_ps(lanesLow + 8, lowC);
+	_mm_storeu_ps(lanesHigh, highA);
+	_mm_storeu_ps(lanesHigh + 4, highB);
+	_mm_storeu_ps(lanesHigh + 8, highC);
+	for(int j = 0; j < 6; j++)
+		_mm_storeu_pd(lanesSum + j*2, sums[j]);
 
-Vector3f getMin(Mesh&mesh)
-{
-	Vector3f min;
-	min.x=0;
-	min.y=0;
-	min.z=0;
-	int n=mesh.vertices.size();
-	for(int i=0;i<n;i++)
+	for(int k = 0; k < 12; k++)
 	{
-		if(min.x > mesh.vertices[i].x)
-			min.x = mesh.vertices[i].x;
-
-		if(min.y > mesh.vertices[i].y)
-			min.y = mesh.vertices[i].y;
+		if(lanesLow[k] < low[k%3]) low[k%3] = lanesLow[k];
+		if(lanesHigh[k] > high[k%3]) high[k%3] = lanesHigh[k];
+		sum[k%3] += lanesSum[k];
+	}
+#endif
 
-		if(min.z > mesh.vertices[i].z)
-			min.z = mesh.vertices[i].z;
+	for(; i < n; i++)
+	{
+		for(int axis = 0; axis < 3; axis++)
+		{
+			float value = v[i*3 + axis];
+			if(value < low[axis]) low[axis] = value;
+			if(value > high[axis]) high[axis] = value;
+			sum[axis] += value;
+		}
 	}
 
-	return min;
-}
\ No newline at end of file
+	mesh.bounds_min.x = low[0];
+	mesh.bounds_min.y = low[1];
+	mesh.bounds_min.z = low[2];
+	mesh.bounds_max.x = high[0];
+	mesh.bounds_max.y = high[1];
+	mesh.bounds_max.z = high[2];
+	mesh.centroid.x = (float)(sum[0]/n);
+	mesh.centroid.y = (float)(sum[1]/n);
+	mesh.centroid.z = (float)(sum[2]/n);
+}
+
+Vector3f getCentroid(const Mesh& mesh)
+{
+	return mesh.centroid;
+}
+
+Vector3f getMax(const Mesh& mesh)
+{
+	return mesh.bounds_max;
+}
+
+Vector3f getMin(const Mesh& mesh)
+{
+	return mesh.bounds_min;
+}
@@ -9,6 +9,7 @@
 #ifndef MESH_H_
 #define MESH_H_
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 #include <sstream>
@@ -32,24 +33,84 @@ struct Face{
 	int texture_idx[3];
 };
 
+struct PackedMesh;
+
+/* Detail levels kept per mesh, including the full detail one */
+#define MAX_MESH_LODS 4
+
 struct Mesh{
     std::vector<Face> faces;
     std::vector<Vector3f> vertices;
     std::vector<Vector3f> vertex_normals;
     std::vector<Vector2f> tex_coords;
+
+    // Filled in by computeMeshBounds when loading and stored in the binary cache
+    Vector3f centroid;
+    Vector3f bounds_min;
+    Vector3f bounds_max;
+
+    // Reduced detail index lists (into the vertices made by weldMesh) built by
+    // buildMeshLods (meshlod.h) and stored in the binary cache. Level 1 first
+    std::vector< std::vector<unsigned int> > lod_indices;
+
+    // Buffer objects created by uploadMesh (meshbuffer.h), with one index buffer
+    // per detail level. When lod_count is non zero drawMesh uses these instead
+    // of the arrays above
+    GLuint vertex_buffer;
+    GLuint index_buffers[MAX_MESH_LODS];
+    GLsizei index_counts[MAX_MESH_LODS];
+    GLenum index_type;
+    int lod_count;
+    size_t buffer_bytes; // Total size of the buffer objects
+
+    // Set by uploadPackedMesh (meshpack.h) when the mesh is kept in the compact
+    // format instead of as loaded. faces, the three arrays after it and
+    // lod_indices are then empty, so the mesh can only be drawn from its buffer
+    // objects
+    std::shared_ptr<PackedMesh> packed;
+
+    Mesh() : vertex_buffer(0), index_type(GL_UNSIGNED_SHORT), lod_count(0), buffer_bytes(0)
+    {
+        centroid.x = centroid.y = centroid.z = 0;
+        bounds_min = bounds_max = centroid;
+        for(int i = 0; i < MAX_MESH_LODS; i++)
+        {
+            index_buffers[i] = 0;
+            index_counts[i] = 0;
+        }
+    }
 };
 
-//Function that returns the centroid of the mesh
-Vector3f getCentroid(Mesh& mesh);
+//Computes centroid, bounds_min and bounds_max in a single (SSE2) pass over the
+//vertices. The loaders call this, so it's only needed after editing vertices
+void computeMeshBounds(Mesh& mesh);
+
+//Return the centroid, and max and min x, y and z co-ordinates, as computed when
+//the mesh was loaded
+Vector3f getCentroid(const Mesh& mesh);
+Vector3f getMax(const Mesh& mesh);
+Vector3f getMin(const Mesh& mesh);
+
+//Loads a Mesh given a path to an obj. The parsed arrays are cached in a binary
+//sidecar (filename + ".meshbin") which is used instead of the obj on later runs
+//for as long as the obj's size and modification time are unchanged. Freshly
+//parsed meshes are reordered by optimizeMesh (meshopt.h) and given detail levels
+//by buildMeshLods (meshlod.h) before being cached.
+//threads is passed on to loadMeshMapped when the obj has to be parsed
+void loadMesh(Mesh& mesh,std::string filename, int threads = 1);
 
-// Return max and min x, y and z co-ordinates
-Vector3f getMax(Mesh&mesh);
-Vector3f getMin(Mesh&mesh);
+//Loads a Mesh by reading the obj line by line through string streams
+void loadMeshStream(Mesh& mesh,std::string filename);
 
-//Loads a Mesh given a path to an obj
-void loadMesh(Mesh& mesh,std::string filename);
+//Loads a Mesh by memory mapping the obj and parsing it in place. Fills the same
+//arrays as loadMesh but allocates each of them once and avoids per-line streams.
+//With threads > 1 large files are split at line boundaries and the pieces are
+//parsed concurrently; the result is identical to the single threaded parse
+void loadMeshMapped(Mesh& mesh,std::string filename, int threads = 1);
 
-//Draws the mesh using OpenGL 
-void drawMesh(Mesh mesh);
+//Draws the mesh using OpenGL, from its buffer objects if it has been uploaded
+//and otherwise in immediate mode. lod selects a reduced detail level (0 is
+//full detail); it is ignored in immediate mode
+void drawMesh(const Mesh& mesh, int lod = 0);
 
 #endif /* MESH_H_ */
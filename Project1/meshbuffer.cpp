@@ -0,0 +1,196 @@
+/*
+ * meshbuffer.cpp
+ */
+
+#include "meshbuffer.h"
+#include "glfuncs.h"
+#include <stdio.h>
+
+namespace {
+	struct CornerKey{
+		int position_idx;
+		int normal_idx;
+		int texture_idx;
+	};
+
+	inline unsigned int hashCorner(const CornerKey& key)
+	{
+		unsigned int hash = (unsigned int)key.position_idx*73856093u
+			^ (unsigned int)key.normal_idx*19349663u
+			^ (unsigned int)key.texture_idx*83492791u;
+		return hash ^ (hash >> 15);
+	}
+
+	inline bool sameCorner(const CornerKey& a, const CornerKey& b)
+	{
+		return a.position_idx == b.position_idx && a.normal_idx == b.normal_idx && a.texture_idx == b.texture_idx;
+	}
+
+	MeshVertex makeVertex(const Mesh& mesh, const CornerKey& key)
+	{
+		MeshVertex vertex;
+		vertex.position = mesh.vertices[key.position_idx];
+
+		if(key.normal_idx >= 0)
+			vertex.normal = mesh.vertex_normals[key.normal_idx];
+		else
+			vertex.normal.x = vertex.normal.y = vertex.normal.z = 0;
+
+		if(key.texture_idx >= 0)
+			vertex.tex_coord = mesh.tex_coords[key.texture_idx];
+		else
+			vertex.tex_coord.x = vertex.tex_coord.y = 0;
+
+		return vertex;
+	}
+}
+
+void weldMesh(const Mesh& mesh, IndexedMesh& indexed)
+{
+	size_t corners = mesh.faces.size()*3;
+
+	/* Open addressing table of vertex numbers, at most half full */
+	size_t tableSize = 16;
+	while(tableSize < corners*2)
+		tableSize *= 2;
+	std::vector<int> table(tableSize, -1);
+	std::vector<CornerKey> keys;
+	keys.reserve(corners);
+
+	indexed.vertices.clear();
+	indexed.vertices.reserve(corners);
+	indexed.indices.resize(corners);
+
+	for(size_t i = 0; i < mesh.faces.size(); i++)
+	{
+		const Face& face = mesh.faces[i];
+		for(int j = 0; j < 3; j++)
+		{
+			CornerKey key;
+			key.position_idx = face.position_idx[j];
+			key.normal_idx = face.normal_idx[j];
+			key.texture_idx = face.texture_idx[j];
+
+			size_t slot = hashCorner(key) & (tableSize - 1);
+			while(table[slot] >= 0 && !sameCorner(keys[table[slot]], key))
+				slot = (slot + 1) & (tableSize - 1);
+
+			if(table[slot] < 0)
+			{
+				table[slot] = (int)keys.size();
+				keys.push_back(key);
+				indexed.vertices.push_back(makeVertex(mesh, key));
+			}
+			indexed.indices[i*3 + j] = (unsigned int)table[slot];
+		}
+	}
+}
+
+namespace {
+	//Creates one index buffer, as 16 bit indices when the vertices allow it
+	GLuint uploadIndices(const std::vector<unsigned int>& indices, GLenum type)
+	{
+		GLuint buffer;
+		pglGenBuffers(1, &buffer);
+		pglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+		if(type == GL_UNSIGNED_SHORT)
+		{
+			std::vector<GLushort> shortIndices(indices.begin(), indices.end());
+			pglBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size()*sizeof(GLushort), &shortIndices[0], GL_STATIC_DRAW);
+		} else {
+			pglBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+		}
+		pglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		return buffer;
+	}
+}
+
+bool uploadMesh(Mesh& mesh)
+{
+	if(!glBuffersSupported || mesh.faces.empty())
+		return false;
+
+	IndexedMesh indexed;
+	weldMesh(mesh, indexed);
+	return uploadIndexedMesh(mesh, indexed);
+}
+
+bool uploadIndexedMesh(Mesh& mesh, const IndexedMesh& indexed)
+{
+	if(!glBuffersSupported || indexed.vertices.empty())
+		return false;
+
+	freeMeshBuffers(mesh);
+	pglGenBuffers(1, &mesh.vertex_buffer);
+	pglBindBuffer(GL_ARRAY_BUFFER, mesh.vertex_buffer);
+	pglBufferData(GL_ARRAY_BUFFER, indexed.vertices.size()*sizeof(MeshVertex), &indexed.vertices[0], GL_STATIC_DRAW);
+	pglBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	/* Every detail level indexes the same vertices */
+	mesh.index_type = indexed.vertices.size() <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	size_t indexSize = mesh.index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	mesh.index_buffers[0] = uploadIndices(indexed.indices, mesh.index_type);
+	mesh.index_counts[0] = (GLsizei)indexed.indices.size();
+	mesh.lod_count = 1;
+	mesh.buffer_bytes = indexed.vertices.size()*sizeof(MeshVertex) + indexed.indices.size()*indexSize;
+
+	for(size_t i = 0; i < mesh.lod_indices.size() && mesh.lod_count < MAX_MESH_LODS; i++)
+	{
+		if(mesh.lod_indices[i].empty())
+			break;
+		mesh.index_buffers[mesh.lod_count] = uploadIndices(mesh.lod_indices[i], mesh.index_type);
+		mesh.index_counts[mesh.lod_count] = (GLsizei)mesh.lod_indices[i].size();
+		mesh.buffer_bytes += mesh.lod_indices[i].size()*indexSize;
+		mesh.lod_count++;
+	}
+
+	printf("Uploaded mesh: %d corners welded into %d vertices (%d bytes), %d-bit indices, %d detail levels\n",
+		(int)indexed.indices.size(), (int)indexed.vertices.size(), (int)(indexed.vertices.size()*sizeof(MeshVertex)),
+		mesh.index_type == GL_UNSIGNED_SHORT ? 16 : 32, mesh.lod_count);
+	return true;
+}
+
+void freeMeshBuffers(Mesh& mesh)
+{
+	if(mesh.vertex_buffer != 0)
+		pglDeleteBuffers(1, &mesh.vertex_buffer);
+	for(int i = 0; i < mesh.lod_count; i++)
+	{
+		pglDeleteBuffers(1, &mesh.index_buffers[i]);
+		mesh.index_buffers[i] = 0;
+		mesh.index_counts[i] = 0;
+	}
+
+	mesh.vertex_buffer = 0;
+	mesh.lod_count = 0;
+	mesh.buffer_bytes = 0;
+}
+
+void drawMeshBuffers(const Mesh& mesh, int lod)
+{
+	const GLsizei stride = sizeof(MeshVertex);
+
+	if(lod < 0)
+		lod = 0;
+	if(lod >= mesh.lod_count)
+		lod = mesh.lod_count - 1;
+
+	glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+	/* With a buffer bound the "pointers" are byte offsets into it */
+	pglBindBuffer(GL_ARRAY_BUFFER, mesh.vertex_buffer);
+	glVertexPointer(3, GL_FLOAT, stride, (const GLvoid*)offsetof(MeshVertex, position));
+	glNormalPointer(GL_FLOAT, stride, (const GLvoid*)offsetof(MeshVertex, normal));
+	glTexCoordPointer(2, GL_FLOAT, stride, (const GLvoid*)offsetof(MeshVertex, tex_coord));
+
+	pglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.index_buffers[lod]);
+	glDrawElements(GL_TRIANGLES, mesh.index_counts[lod], mesh.index_type, 0);
+
+	/* The rest of the program uses client side arrays, so leave nothing bound */
+	pglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	pglBindBuffer(GL_ARRAY_BUFFER, 0);
+	glPopClientAttrib();
+}
@@ -0,0 +1,48 @@
+/*
+ * meshbuffer.h
+ *
+ * Converts a Mesh into one interleaved vertex per unique face corner plus an
+ * index list, and keeps that on the GPU so the whole mesh is one draw call.
+ */
+
+#ifndef MESHBUFFER_H_
+#define MESHBUFFER_H_
+
+#include <vector>
+#include "mesh.h"
+
+struct MeshVertex{
+	Vector3f position;
+	Vector3f normal;
+	Vector2f tex_coord;
+};
+
+struct IndexedMesh{
+	std::vector<MeshVertex> vertices;
+	std::vector<unsigned int> indices; // Three per triangle, in the order of Mesh::faces
+};
+
+//Welds the separate position/normal/texture indices of every face corner into
+//a single vertex index, giving each distinct combination exactly one vertex.
+//Vertices are numbered in the order they are first used by the faces
+void weldMesh(const Mesh& mesh, IndexedMesh& indexed);
+
+//Welds the mesh and uploads it into a vertex buffer object plus an index buffer
+//object for every detail level in mesh.lod_indices (16 bit indices when they
+//fit). Returns false, leaving the mesh to be drawn in immediate mode, if buffer
+//objects aren't supported
+bool uploadMesh(Mesh& mesh);
+
+//As uploadMesh, for vertices that have already been welded (or unpacked). They
+//must be numbered as weldMesh would number them, since mesh.lod_indices refer
+//to them
+bool uploadIndexedMesh(Mesh& mesh, const IndexedMesh& indexed);
+
+//Deletes the buffers created by uploadMesh
+void freeMeshBuffers(Mesh& mesh);
+
+//Draws one detail level of a mesh previously passed to uploadMesh with a single
+//glDrawElements call
+void drawMeshBuffers(const Mesh& mesh, int lod);
+
+#endif /* MESHBUFFER_H_ */
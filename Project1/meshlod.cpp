@@ -0,0 +1,330 @@
+/*
+ * meshlod.cpp
+ */
+
+#include "meshlod.h"
+#include "meshopt.h"
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+	/* Give up on a level after this many rounds of collapses */
+	const int maxCollapsePasses = 32;
+
+	//Symmetric 4x4 matrix measuring squared distance to a set of planes
+	struct Quadric{
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+	};
+
+	void addPlane(Quadric& q, double a, double b, double c, double d, double weight)
+	{
+		q.a2 += weight*a*a; q.ab += weight*a*b; q.ac += weight*a*c; q.ad += weight*a*d;
+		q.b2 += weight*b*b; q.bc += weight*b*c; q.bd += weight*b*d;
+		q.c2 += weight*c*c; q.cd += weight*c*d;
+		q.d2 += weight*d*d;
+	}
+
+	void addQuadric(Quadric& q, const Quadric& other)
+	{
+		q.a2 += other.a2; q.ab += other.ab; q.ac += other.ac; q.ad += other.ad;
+		q.b2 += other.b2; q.bc += other.bc; q.bd += other.bd;
+		q.c2 += other.c2; q.cd += other.cd;
+		q.d2 += other.d2;
+	}
+
+	double quadricError(const Quadric& q, const Quadric& r, const Vector3f& p)
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double a2 = q.a2 + r.a2, ab = q.ab + r.ab, ac = q.ac + r.ac, ad = q.ad + r.ad;
+		double b2 = q.b2 + r.b2, bc = q.bc + r.bc, bd = q.bd + r.bd;
+		double c2 = q.c2 + r.c2, cd = q.cd + r.cd, d2 = q.d2 + r.d2;
+
+		return a2*x*x + 2*ab*x*y + 2*ac*x*z + 2*ad*x
+			+ b2*y*y + 2*bc*y*z + 2*bd*y
+			+ c2*z*z + 2*cd*z
+			+ d2;
+	}
+
+	Vector3f triangleNormal(const Vector3f& p0, const Vector3f& p1, const Vector3f& p2)
+	{
+		Vector3f e1 = {p1.x - p0.x, p1.y - p0.y, p1.z - p0.z};
+		Vector3f e2 = {p2.x - p0.x, p2.y - p0.y, p2.z - p0.z};
+		Vector3f n = {e1.y*e2.z - e1.z*e2.y, e1.z*e2.x - e1.x*e2.z, e1.x*e2.y - e1.y*e2.x};
+		return n;
+	}
+
+	struct Collapse{
+		double cost;
+		unsigned int from; // Vertex removed
+		unsigned int to;   // Vertex it is merged into
+
+		bool operator<(const Collapse& other) const
+		{
+			return cost < other.cost;
+		}
+	};
+
+	//Simplification in progress: the current index list plus per-vertex state
+	struct Simplifier{
+		const std::vector<MeshVertex>* vertices;
+		std::vector<unsigned int> indices;
+		std::vector<Quadric> quadrics;
+		std::vector<bool> locked; // Never removed: boundary, seam and unused vertices
+	};
+
+	void initSimplifier(Simplifier& s, const IndexedMesh& mesh, const std::vector<unsigned int>& indices)
+	{
+		size_t vertexCount = mesh.vertices.size();
+		s.vertices = &mesh.vertices;
+		s.indices = indices;
+
+		Quadric zero;
+		memset(&zero, 0, sizeof(zero));
+		s.quadrics.assign(vertexCount, zero);
+		s.locked.assign(vertexCount, true);
+
+		/* Every triangle adds its plane, weighted by area, to its corners */
+		size_t i;
+		for(i = 0; i < indices.size(); i += 3)
+		{
+			const Vector3f& p0 = mesh.vertices[indices[i]].position;
+			Vector3f n = triangleNormal(p0, mesh.vertices[indices[i + 1]].position, mesh.vertices[indices[i + 2]].position);
+			double length = sqrt((double)n.x*n.x + (double)n.y*n.y + (double)n.z*n.z);
+			if(length == 0)
+				continue;
+
+			double a = n.x/length, b = n.y/length, c = n.z/length;
+			double d = -(a*p0.x + b*p0.y + c*p0.z);
+			for(int j = 0; j < 3; j++)
+				addPlane(s.quadrics[indices[i + j]], a, b, c, d, length*0.5);
+		}
+
+		/* Unlock the vertices that are used, then lock the ends of every edge with only one triangle */
+		for(i = 0; i < indices.size(); i++)
+			s.locked[indices[i]] = false;
+
+		std::vector<unsigned long long> edges;
+		edges.reserve(indices.size());
+		for(i = 0; i < indices.size(); i += 3)
+		{
+			for(int j = 0; j < 3; j++)
+			{
+				unsigned long long a = indices[i + j], b = indices[i + (j + 1)%3];
+				edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		for(i = 0; i < edges.size(); )
+		{
+			size_t j = i + 1;
+			while(j < edges.size() && edges[j] == edges[i])
+				j++;
+			if(j - i == 1)
+			{
+				s.locked[(size_t)(edges[i] >> 32)] = true;
+				s.locked[(size_t)(edges[i] & 0xffffffffu)] = true;
+			}
+			i = j;
+		}
+
+		/* Lock vertices that share a position with another vertex, i.e. sit on a UV or normal seam */
+		std::vector<unsigned int> byPosition(vertexCount);
+		for(i = 0; i < vertexCount; i++)
+			byPosition[i] = (unsigned int)i;
+		struct PositionLess{
+			const std::vector<MeshVertex>* v;
+			bool operator()(unsigned int a, unsigned int b) const
+			{
+				return memcmp(&(*v)[a].position, &(*v)[b].position, sizeof(Vector3f)) < 0;
+			}
+		} positionLess = {&mesh.vertices};
+		std::sort(byPosition.begin(), byPosition.end(), positionLess);
+		for(i = 1; i < vertexCount; i++)
+		{
+			if(!positionLess(byPosition[i - 1], byPosition[i]))
+				s.locked[byPosition[i - 1]] = s.locked[byPosition[i]] = true;
+		}
+	}
+
+	//Returns true if moving "from" onto "to" would turn any remaining triangle over
+	bool collapseFlips(const Simplifier& s, const std::vector<unsigned int>& adjacencyStart,
+		const std::vector<unsigned int>& adjacency, unsigned int from, unsigned int to)
+	{
+		const std::vector<MeshVertex>& v = *s.vertices;
+		for(unsigned int k = adjacencyStart[from]; k < adjacencyStart[from + 1]; k++)
+		{
+			const unsigned int* t = &s.indices[adjacency[k]*3];
+			if(t[0] == to || t[1] == to || t[2] == to)
+				continue; // This triangle disappears
+
+			Vector3f p[3], q[3];
+			for(int j = 0; j < 3; j++)
+			{
+				p[j] = v[t[j]].position;
+				q[j] = t[j] == from ? v[to].position : p[j];
+			}
+			Vector3f before = triangleNormal(p[0], p[1], p[2]);
+			Vector3f after = triangleNormal(q[0], q[1], q[2]);
+			if(before.x*after.x + before.y*after.y + before.z*after.z <= 0)
+				return true;
+		}
+		return false;
+	}
+
+	//Collapses edges, cheapest first, until at most target triangles remain
+	void collapseToTarget(Simplifier& s, size_t target)
+	{
+		const std::vector<MeshVertex>& v = *s.vertices;
+		size_t vertexCount = v.size();
+
+		for(int pass = 0; pass < maxCollapsePasses && s.indices.size()/3 > target; pass++)
+		{
+			size_t i;
+
+			/* Triangles around each vertex */
+			std::vector<unsigned int> adjacencyStart(vertexCount + 1, 0);
+			for(i = 0; i < s.indices.size(); i++)
+				adjacencyStart[s.indices[i] + 1]++;
+			for(i = 0; i < vertexCount; i++)
+				adjacencyStart[i + 1] += adjacencyStart[i];
+			std::vector<unsigned int> adjacency(s.indices.size());
+			std::vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+			for(i = 0; i < s.indices.size(); i++)
+				adjacency[fill[s.indices[i]]++] = (unsigned int)(i/3);
+
+			/* Cheapest allowed direction for every edge */
+			std::vector<Collapse> collapses;
+			collapses.reserve(s.indices.size());
+			for(i = 0; i < s.indices.size(); i += 3)
+			{
+				for(int j = 0; j < 3; j++)
+				{
+					unsigned int a = s.indices[i + j], b = s.indices[i + (j + 1)%3];
+					if(a > b && !(s.locked[a] && s.locked[b]))
+					{
+						/* Each interior edge appears twice, keep the a > b copy (boundary edges are locked anyway) */
+						Collapse c;
+						double costAB = s.locked[a] ? -1 : quadricError(s.quadrics[a], s.quadrics[b], v[b].position);
+						double costBA = s.locked[b] ? -1 : quadricError(s.quadrics[a], s.quadrics[b], v[a].position);
+						if(costBA < 0 || (costAB >= 0 && costAB <= costBA))
+						{
+							c.cost = costAB; c.from = a; c.to = b;
+						} else {
+							c.cost = costBA; c.from = b; c.to = a;
+						}
+						collapses.push_back(c);
+					}
+				}
+			}
+			std::sort(collapses.begin(), collapses.end());
+
+			/* Apply them, leaving alone anything near a vertex already changed this pass */
+			std::vector<unsigned int> remap(vertexCount);
+			for(i = 0; i < vertexCount; i++)
+				remap[i] = (unsigned int)i;
+			std::vector<bool> touched(vertexCount, false);
+			size_t triangles = s.indices.size()/3;
+			size_t applied = 0;
+
+			for(i = 0; i < collapses.size() && triangles > target; i++)
+			{
+				const Collapse& c = collapses[i];
+				if(touched[c.from] || touched[c.to])
+					continue;
+				if(collapseFlips(s, adjacencyStart, adjacency, c.from, c.to))
+					continue;
+
+				remap[c.from] = c.to;
+				addQuadric(s.quadrics[c.to], s.quadrics[c.from]);
+				applied++;
+
+				for(unsigned int k = adjacencyStart[c.from]; k < adjacencyStart[c.from + 1]; k++)
+				{
+					const unsigned int* t = &s.indices[adjacency[k]*3];
+					if(t[0] == c.to || t[1] == c.to || t[2] == c.to)
+						triangles--;
+					touched[t[0]] = touched[t[1]] = touched[t[2]] = true;
+				}
+			}
+			if(applied == 0)
+				break;
+
+			/* Rewrite the index list, dropping triangles that lost a corner */
+			size_t out = 0;
+			for(i = 0; i < s.indices.size(); i += 3)
+			{
+				unsigned int a = remap[s.indices[i]], b = remap[s.indices[i + 1]], c = remap[s.indices[i + 2]];
+				if(a == b || b == c || c == a)
+					continue;
+				s.indices[out++] = a;
+				s.indices[out++] = b;
+				s.indices[out++] = c;
+			}
+			s.indices.resize(out);
+		}
+	}
+}
+
+void simplifyMesh(const IndexedMesh& mesh, const std::vector<unsigned int>& indices, size_t targetTriangles, std::vector<unsigned int>& result)
+{
+	Simplifier s;
+	initSimplifier(s, mesh, indices);
+	collapseToTarget(s, targetTriangles);
+	result.swap(s.indices);
+}
+
+void buildMeshLods(Mesh& mesh, const char* name)
+{
+	mesh.lod_indices.clear();
+	if(mesh.faces.empty())
+		return;
+
+	IndexedMesh indexed;
+	weldMesh(mesh, indexed);
+
+	Simplifier s;
+	initSimplifier(s, indexed, indexed.indices);
+
+	printf("Mesh %s detail levels: %d", name, (int)mesh.faces.size());
+	for(int level = 1; level < MAX_MESH_LODS; level++)
+	{
+		size_t previous = s.indices.size()/3;
+		collapseToTarget(s, previous/2);
+
+		/* Not worth another buffer if hardly anything could be removed */
+		if(s.indices.size()/3 > previous*9/10)
+			break;
+
+		mesh.lod_indices.push_back(s.indices);
+		optimizeVertexCache(mesh.lod_indices.back(), indexed.vertices.size());
+		printf(" -> %d", (int)(s.indices.size()/3));
+	}
+	printf(" triangles\n");
+}
+
+int selectMeshLod(const Mesh& mesh, float distance, float fovY, int viewportHeight)
+{
+	/* Levels are only drawable once uploaded */
+	int available = mesh.lod_count - 1;
+	if(available <= 0 || distance <= 0)
+		return 0;
+
+	float dx = mesh.bounds_max.x - mesh.bounds_min.x;
+	float dy = mesh.bounds_max.y - mesh.bounds_min.y;
+	float dz = mesh.bounds_max.z - mesh.bounds_min.z;
+	float radius = 0.5f*sqrtf(dx*dx + dy*dy + dz*dz);
+
+	/* Height of the bounding sphere on screen */
+	float pixels = radius*(float)viewportHeight/(distance*tanf(fovY*0.5f*3.14159265f/180.0f));
+
+	int lod = 0;
+	float threshold = LOD_FULL_DETAIL_PIXELS;
+	while(lod < available && pixels < threshold)
+	{
+		lod++;
+		threshold *= 0.5f;
+	}
+	return lod;
+}
@@ -0,0 +1,36 @@
+/*
+ * meshlod.h
+ *
+ * Builds lower detail versions of a mesh by quadric error edge collapse
+ * (Garland & Heckbert 1997) and picks one from its size on screen.
+ *
+ * Edges are only collapsed onto one of their existing vertices, so every level
+ * indexes the same welded vertex buffer. Vertices on a boundary of the welded
+ * mesh - which includes every UV seam and hard normal edge - are never removed,
+ * so texture mapping is unaffected.
+ */
+
+#ifndef MESHLOD_H_
+#define MESHLOD_H_
+
+#include <vector>
+#include "mesh.h"
+#include "meshbuffer.h"
+
+/* Projected height (in pixels) below which the first reduced level is used.
+   Every further halving of the height drops another level */
+#define LOD_FULL_DETAIL_PIXELS 400.0f
+
+//Removes triangles from an index list by edge collapse until no more than
+//targetTriangles remain (or nothing more can be collapsed)
+void simplifyMesh(const IndexedMesh& mesh, const std::vector<unsigned int>& indices, size_t targetTriangles, std::vector<unsigned int>& result);
+
+//Fills mesh.lod_indices with MAX_MESH_LODS-1 levels, each with roughly half
+//the triangles of the one before, and prints their triangle counts
+void buildMeshLods(Mesh& mesh, const char* name);
+
+//Picks the level to draw for a mesh seen from distance, given the vertical
+//field of view (degrees) and viewport height in pixels
+int selectMeshLod(const Mesh& mesh, float distance, float fovY, int viewportHeight);
+
+#endif /* MESHLOD_H_ */
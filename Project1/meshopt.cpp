@@ -0,0 +1,268 @@
+/*
+ * meshopt.cpp
+ *
+ * Vertex cache optimisation follows "Linear-Speed Vertex Cache Optimisation"
+ * by Tom Forsyth (2006), using his suggested constants.
+ */
+
+#include "meshopt.h"
+#include "meshbuffer.h"
+#include <math.h>
+#include <stdio.h>
+
+namespace {
+	/* Forsyth's scoring constants */
+	const int maxCacheSize = 32;
+	const float cacheDecayPower = 1.5f;
+	const float lastTriScore = 0.75f;
+	const float valenceBoostScale = 2.0f;
+	const float valenceBoostPower = 0.5f;
+	const int maxValenceScore = 64;
+
+	float cacheScores[maxCacheSize];
+	float valenceScores[maxValenceScore];
+	bool scoresReady = false;
+
+	void initScores(void)
+	{
+		for(int i = 0; i < maxCacheSize; i++)
+		{
+			if(i < 3)
+				cacheScores[i] = lastTriScore; // The triangle just drawn gets a fixed score so it isn't reused at once
+			else
+				cacheScores[i] = powf(1.0f - (float)(i - 3)/(float)(maxCacheSize - 3), cacheDecayPower);
+		}
+		for(int i = 0; i < maxValenceScore; i++)
+			valenceScores[i] = i == 0 ? 0.0f : valenceBoostScale*powf((float)i, -valenceBoostPower);
+		scoresReady = true;
+	}
+
+	//Score of a vertex given its position in the LRU cache (-1 if absent) and how many triangles still use it
+	inline float vertexScore(int cachePosition, int remaining)
+	{
+		if(remaining == 0)
+			return -1.0f; // Nothing left to draw, so no point keeping it
+
+		float score = cachePosition >= 0 ? cacheScores[cachePosition] : 0.0f;
+		return score + valenceScores[remaining < maxValenceScore ? remaining : maxValenceScore - 1];
+	}
+
+	//Computes the order the triangles of an index list should be drawn in
+	void forsythOrder(const std::vector<unsigned int>& indices, size_t vertexCount, std::vector<unsigned int>& order)
+	{
+		if(!scoresReady)
+			initScores();
+
+		size_t triangleCount = indices.size()/3;
+		order.clear();
+		order.reserve(triangleCount);
+
+		/* Triangles that use each vertex, packed together (only the first remaining[v] are still to be drawn) */
+		std::vector<int> remaining(vertexCount, 0);
+		std::vector<unsigned int> adjacencyStart(vertexCount + 1, 0);
+		size_t i;
+		for(i = 0; i < indices.size(); i++)
+			remaining[indices[i]]++;
+		for(i = 0; i < vertexCount; i++)
+			adjacencyStart[i + 1] = adjacencyStart[i] + remaining[i];
+
+		std::vector<unsigned int> adjacency(indices.size());
+		std::vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+		for(i = 0; i < indices.size(); i++)
+			adjacency[fill[indices[i]]++] = (unsigned int)(i/3);
+
+		std::vector<int> cachePosition(vertexCount, -1);
+		std::vector<float> scores(vertexCount);
+		for(i = 0; i < vertexCount; i++)
+			scores[i] = vertexScore(-1, remaining[i]);
+
+		std::vector<float> triangleScores(triangleCount);
+		std::vector<bool> emitted(triangleCount, false);
+		int bestTriangle = -1;
+		float bestScore = -1.0f;
+		for(i = 0; i < triangleCount; i++)
+		{
+			triangleScores[i] = scores[indices[i*3]] + scores[indices[i*3 + 1]] + scores[indices[i*3 + 2]];
+			if(triangleScores[i] > bestScore)
+			{
+				bestScore = triangleScores[i];
+				bestTriangle = (int)i;
+			}
+		}
+
+		/* The cache briefly holds three extra entries while a triangle is added */
+		int cache[maxCacheSize + 3];
+		int newCache[maxCacheSize + 3];
+		int cacheCount = 0;
+		size_t scanPosition = 0;
+
+		while(order.size() < triangleCount)
+		{
+			/* Dead end: carry on with the next triangle in the original order */
+			if(bestTriangle < 0)
+			{
+				while(emitted[scanPosition])
+					scanPosition++;
+				bestTriangle = (int)scanPosition;
+			}
+
+			order.push_back(bestTriangle);
+			emitted[bestTriangle] = true;
+
+			const unsigned int* corner = &indices[bestTriangle*3];
+			int newCount = 0;
+			for(int j = 0; j < 3; j++)
+			{
+				unsigned int v = corner[j];
+
+				/* Remove the triangle from the vertex's list of triangles still to draw */
+				unsigned int* list = &adjacency[adjacencyStart[v]];
+				for(int k = 0; k < remaining[v]; k++)
+				{
+					if(list[k] == (unsigned int)bestTriangle)
+					{
+						list[k] = list[remaining[v] - 1];
+						break;
+					}
+				}
+				remaining[v]--;
+
+				newCache[newCount++] = v;
+			}
+
+			/* The old cache entries move down behind the three new ones */
+			for(int j = 0; j < cacheCount; j++)
+			{
+				int v = cache[j];
+				if(v != (int)corner[0] && v != (int)corner[1] && v != (int)corner[2])
+					newCache[newCount++] = v;
+			}
+
+			/* Rescore everything that was in the cache, spreading the change to the triangles */
+			bestTriangle = -1;
+			bestScore = -1.0f;
+			for(int j = 0; j < newCount; j++)
+			{
+				int v = newCache[j];
+				cachePosition[v] = j < maxCacheSize ? j : -1;
+
+				float newScore = vertexScore(cachePosition[v], remaining[v]);
+				float delta = newScore - scores[v];
+				scores[v] = newScore;
+
+				const unsigned int* list = &adjacency[adjacencyStart[v]];
+				for(int k = 0; k < remaining[v]; k++)
+				{
+					unsigned int t = list[k];
+					triangleScores[t] += delta;
+					if(triangleScores[t] > bestScore)
+					{
+						bestScore = triangleScores[t];
+						bestTriangle = (int)t;
+					}
+				}
+			}
+
+			cacheCount = newCount < maxCacheSize ? newCount : maxCacheSize;
+			for(int j = 0; j < cacheCount; j++)
+				cache[j] = newCache[j];
+		}
+	}
+
+	//Renumbers one of the attribute arrays of a mesh in the order the faces first use it.
+	//Entries no face refers to are kept, after the used ones
+	template<class T>
+	void remapByFirstUse(std::vector<T>& data, std::vector<Face>& faces, int (Face::*member)[3])
+	{
+		std::vector<int> remap(data.size(), -1);
+		std::vector<T> reordered;
+		reordered.reserve(data.size());
+
+		for(size_t i = 0; i < faces.size(); i++)
+		{
+			int* index = faces[i].*member;
+			for(int j = 0; j < 3; j++)
+			{
+				if(index[j] < 0)
+					continue;
+				if(remap[index[j]] < 0)
+				{
+					remap[index[j]] = (int)reordered.size();
+					reordered.push_back(data[index[j]]);
+				}
+				index[j] = remap[index[j]];
+			}
+		}
+		for(size_t i = 0; i < data.size(); i++)
+			if(remap[i] < 0)
+				reordered.push_back(data[i]);
+
+		data.swap(reordered);
+	}
+}
+
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, int cacheSize)
+{
+	/* A vertex is in the FIFO if fewer than cacheSize misses have happened since it was added */
+	std::vector<long> insertedAt(vertexCount, -(long)cacheSize - 1);
+	long misses = 0;
+
+	for(size_t i = 0; i < indices.size(); i++)
+	{
+		unsigned int v = indices[i];
+		if(misses - insertedAt[v] > cacheSize)
+		{
+			insertedAt[v] = misses;
+			misses++;
+		}
+	}
+
+	VertexCacheStats stats;
+	stats.acmr = indices.empty() ? 0.0f : (float)misses/(float)(indices.size()/3);
+	stats.atvr = vertexCount == 0 ? 0.0f : (float)misses/(float)vertexCount;
+	return stats;
+}
+
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+{
+	std::vector<unsigned int> order;
+	forsythOrder(indices, vertexCount, order);
+
+	std::vector<unsigned int> reordered(indices.size());
+	for(size_t i = 0; i < order.size(); i++)
+		for(int j = 0; j < 3; j++)
+			reordered[i*3 + j] = indices[order[i]*3 + j];
+
+	indices.swap(reordered);
+}
+
+void optimizeMesh(Mesh& mesh, const char* name)
+{
+	if(mesh.faces.empty())
+		return;
+
+	IndexedMesh indexed;
+	weldMesh(mesh, indexed);
+	VertexCacheStats before = analyzeVertexCache(indexed.indices, indexed.vertices.size(), VERTEX_CACHE_REPORT_SIZE);
+
+	/* Draw the faces in cache friendly order */
+	std::vector<unsigned int> order;
+	forsythOrder(indexed.indices, indexed.vertices.size(), order);
+
+	std::vector<Face> faces(mesh.faces.size());
+	for(size_t i = 0; i < order.size(); i++)
+		faces[i] = mesh.faces[order[i]];
+	mesh.faces.swap(faces);
+
+	/* Then store the vertex data in the order it's fetched. weldMesh numbers
+	   vertices by first use, so the welded buffer follows the same order */
+	remapByFirstUse(mesh.vertices, mesh.faces, &Face::position_idx);
+	remapByFirstUse(mesh.vertex_normals, mesh.faces, &Face::normal_idx);
+	remapByFirstUse(mesh.tex_coords, mesh.faces, &Face::texture_idx);
+
+	weldMesh(mesh, indexed);
+	VertexCacheStats after = analyzeVertexCache(indexed.indices, indexed.vertices.size(), VERTEX_CACHE_REPORT_SIZE);
+
+	printf("Optimised mesh %s for a %d entry vertex cache: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+		name, VERTEX_CACHE_REPORT_SIZE, before.acmr, after.acmr, before.atvr, after.atvr);
+}
@@ -0,0 +1,34 @@
+/*
+ * meshopt.h
+ *
+ * Reorders a mesh so the GPU transforms as few vertices as possible: triangles
+ * are sorted for post-transform cache hits (Tom Forsyth's linear-speed vertex
+ * cache optimisation) and vertex data is then laid out in the order it is used.
+ */
+
+#ifndef MESHOPT_H_
+#define MESHOPT_H_
+
+#include <vector>
+#include "mesh.h"
+
+/* Size of the FIFO cache used when reporting ACMR/ATVR */
+#define VERTEX_CACHE_REPORT_SIZE 16
+
+struct VertexCacheStats{
+	float acmr; // Average cache miss ratio: vertices transformed per triangle (0.5 is ideal)
+	float atvr; // Average transform to vertex ratio: vertices transformed per vertex (1.0 is ideal)
+};
+
+//Simulates a FIFO post-transform cache of cacheSize entries over an index list
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, int cacheSize);
+
+//Reorders the triangles of an index list for vertex cache locality
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount);
+
+//Runs both passes over a mesh: reorders Mesh::faces for the vertex cache, then
+//renumbers positions, normals and texture coordinates in order of first use.
+//Prints ACMR and ATVR before and after, labelled with name
+void optimizeMesh(Mesh& mesh, const char* name);
+
+#endif /* MESHOPT_H_ */
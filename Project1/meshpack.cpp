@@ -0,0 +1,406 @@
+/*
+ * meshpack.cpp
+ */
+
+#include "meshpack.h"
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MESHPACK_SSE2
+#endif
+
+namespace {
+	/* Float to half with round to nearest even. Values too large for a half
+	   become infinity, NaN stays NaN */
+	unsigned short floatToHalf(float value)
+	{
+		unsigned int bits;
+		memcpy(&bits, &value, sizeof(bits));
+
+		unsigned int sign = (bits >> 16) & 0x8000;
+		bits &= 0x7fffffff;
+
+		if(bits >= 0x47800000) // Beyond the half range, or Inf/NaN
+			return (unsigned short)(sign | (bits > 0x7f800000 ? 0x7e00 : 0x7c00));
+
+		if(bits < 0x38800000) // Below the smallest normal half
+		{
+			/* Adding 0.5 lines the denormal half's mantissa up with the bottom
+			   of the float's, and the float add does the rounding */
+			float magnitude;
+			memcpy(&magnitude, &bits, sizeof(magnitude));
+			magnitude += 0.5f;
+			unsigned int denormal;
+			memcpy(&denormal, &magnitude, sizeof(denormal));
+			return (unsigned short)(sign | (denormal - 0x3f000000));
+		}
+
+		unsigned int oddMantissa = (bits >> 13) & 1;
+		bits += 0xc8000fff + oddMantissa; // Rebias the exponent (-112 << 23) and round
+		return (unsigned short)(sign | (bits >> 13));
+	}
+
+	float halfToFloat(unsigned short half)
+	{
+		unsigned int sign = (unsigned int)(half & 0x8000) << 16;
+		unsigned int shifted = (unsigned int)(half & 0x7fff) << 13;
+		unsigned int bits;
+		float value;
+
+		/* Scaling by 2^112 rebiases the exponent and normalises denormals */
+		const float magic = 5.192296858534828e33f;
+		memcpy(&value, &shifted, sizeof(value));
+		value *= magic;
+		memcpy(&bits, &value, sizeof(bits));
+		if((half & 0x7fff) > 0x7bff)
+			bits |= 0x7f800000;
+		bits |= sign;
+
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	inline float signNotZero(float value)
+	{
+		return value >= 0 ? 1.0f : -1.0f;
+	}
+
+	/* Octahedral normal encoding (Meyer et al. 2010): project onto the
+	   octahedron |x|+|y|+|z| = 1, then fold the lower half over the upper */
+	void octEncode(const Vector3f& normal, int bits, int& u, int& v)
+	{
+		float length = fabs(normal.x) + fabs(normal.y) + fabs(normal.z);
+		float x = 0, y = 0;
+		if(length > 0)
+		{
+			x = normal.x/length;
+			y = normal.y/length;
+			if(normal.z < 0)
+			{
+				float foldedX = (1 - fabs(y))*signNotZero(x);
+				float foldedY = (1 - fabs(x))*signNotZero(y);
+				x = foldedX;
+				y = foldedY;
+			}
+		}
+
+		float range = (float)((1 << (bits - 1)) - 1);
+		u = (int)floor(x*range + 0.5f);
+		v = (int)floor(y*range + 0.5f);
+	}
+
+	Vector3f octDecode(float x, float y)
+	{
+		Vector3f normal;
+		float z = 1 - fabs(x) - fabs(y);
+		float t = z < 0 ? -z : 0;
+		normal.x = x >= 0 ? x - t : x + t;
+		normal.y = y >= 0 ? y - t : y + t;
+		normal.z = z;
+
+		float length = sqrt(normal.x*normal.x + normal.y*normal.y + normal.z*normal.z);
+		normal.x /= length;
+		normal.y /= length;
+		normal.z /= length;
+		return normal;
+	}
+
+	inline void getNormalComponents(const PackedMesh& packed, size_t i, float& x, float& y)
+	{
+		if(packed.normal_bits == 8)
+		{
+			unsigned short both = packed.normals[i];
+			x = (float)(signed char)(both & 0xff)/127.0f;
+			y = (float)(signed char)(both >> 8)/127.0f;
+		} else {
+			x = (float)(short)packed.normals[i*2]/32767.0f;
+			y = (float)(short)packed.normals[i*2 + 1]/32767.0f;
+		}
+
+		/* -128 and -32768 are one step past -1 */
+		if(x < -1) x = -1;
+		if(y < -1) y = -1;
+	}
+
+	void unpackVertexScalar(const PackedMesh& packed, size_t i, MeshVertex& vertex)
+	{
+		const unsigned short* position = &packed.positions[i*3];
+		vertex.position.x = packed.position_offset.x + position[0]*packed.position_scale.x;
+		vertex.position.y = packed.position_offset.y + position[1]*packed.position_scale.y;
+		vertex.position.z = packed.position_offset.z + position[2]*packed.position_scale.z;
+
+		float x, y;
+		getNormalComponents(packed, i, x, y);
+		vertex.normal = octDecode(x, y);
+
+		vertex.tex_coord.x = halfToFloat(packed.tex_coords[i*2]);
+		vertex.tex_coord.y = halfToFloat(packed.tex_coords[i*2 + 1]);
+	}
+
+#ifdef MESHPACK_SSE2
+	inline __m128 absPs(__m128 value)
+	{
+		return _mm_andnot_ps(_mm_set1_ps(-0.0f), value);
+	}
+
+	/* Four halves, one in the bottom of each 32 bit lane, to floats */
+	inline __m128 halfToFloat4(__m128i half)
+	{
+		const __m128i noSign = _mm_set1_epi32(0x7fff);
+		const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+		const __m128i largestFinite = _mm_set1_epi32(0x7bff);
+		const __m128 infNanExponent = _mm_castsi128_ps(_mm_set1_epi32(255 << 23));
+
+		__m128i magnitude = _mm_and_si128(half, noSign);
+		__m128i sign = _mm_slli_epi32(_mm_xor_si128(half, magnitude), 16);
+		__m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(magnitude, 13)), magic);
+		__m128 infNan = _mm_and_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(magnitude, largestFinite)), infNanExponent);
+		return _mm_or_ps(scaled, _mm_or_ps(_mm_castsi128_ps(sign), infNan));
+	}
+
+	/* Decodes four vertices starting at i into planar x/y/z arrays */
+	inline void unpackNormals4(const PackedMesh& packed, size_t i, float* nx, float* ny, float* nz)
+	{
+		__m128 x, y;
+		if(packed.normal_bits == 8)
+		{
+			__m128i both = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)&packed.normals[i]), _mm_setzero_si128());
+			x = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(both, 24), 24));
+			y = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(both, 16), 24));
+			x = _mm_mul_ps(x, _mm_set1_ps(1.0f/127.0f));
+			y = _mm_mul_ps(y, _mm_set1_ps(1.0f/127.0f));
+		} else {
+			__m128i both = _mm_loadu_si128((const __m128i*)&packed.normals[i*2]);
+			x = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(both, 16), 16));
+			y = _mm_cvtepi32_ps(_mm_srai_epi32(both, 16));
+			x = _mm_mul_ps(x, _mm_set1_ps(1.0f/32767.0f));
+			y = _mm_mul_ps(y, _mm_set1_ps(1.0f/32767.0f));
+		}
+		x = _mm_max_ps(x, _mm_set1_ps(-1.0f));
+		y = _mm_max_ps(y, _mm_set1_ps(-1.0f));
+
+		/* Unfold: t = max(-z, 0) is moved from each of x and y towards zero */
+		__m128 z = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(1.0f), absPs(x)), absPs(y));
+		__m128 t = _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), z), _mm_setzero_ps());
+		__m128 signMask = _mm_set1_ps(-0.0f);
+		x = _mm_sub_ps(x, _mm_or_ps(t, _mm_and_ps(x, signMask)));
+		y = _mm_sub_ps(y, _mm_or_ps(t, _mm_and_ps(y, signMask)));
+
+		__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+		_mm_storeu_ps(nx, _mm_div_ps(x, length));
+		_mm_storeu_ps(ny, _mm_div_ps(y, length));
+		_mm_storeu_ps(nz, _mm_div_ps(z, length));
+	}
+#endif
+}
+
+int packedVertexBytes(const PackedMesh& packed)
+{
+	return 3*2 + (packed.normal_bits == 8 ? 2 : 4) + 2*2;
+}
+
+size_t packedMeshBytes(const PackedMesh& packed)
+{
+	return (packed.positions.size() + packed.normals.size() + packed.tex_coords.size() + packed.indices16.size())*sizeof(unsigned short)
+		+ packed.indices32.size()*sizeof(unsigned int);
+}
+
+void packMesh(const Mesh& mesh, PackedMesh& packed, int normalBits)
+{
+	IndexedMesh indexed;
+	weldMesh(mesh, indexed);
+	size_t count = indexed.vertices.size();
+
+	packed.normal_bits = normalBits == 8 ? 8 : 16;
+	packed.positions.resize(count*3);
+	packed.normals.resize(packed.normal_bits == 8 ? count : count*2);
+	packed.tex_coords.resize(count*2);
+	packed.indices16.clear();
+	packed.indices32.clear();
+	if(count <= 65536)
+		packed.indices16.assign(indexed.indices.begin(), indexed.indices.end());
+	else
+		packed.indices32 = indexed.indices;
+
+	/* Quantisation grid over the bounds of the vertices actually used */
+	Vector3f low, high;
+	low.x = low.y = low.z = 0;
+	high = low;
+	if(count > 0)
+		low = high = indexed.vertices[0].position;
+	for(size_t i = 1; i < count; i++)
+	{
+		const Vector3f& position = indexed.vertices[i].position;
+		if(position.x < low.x) low.x = position.x;
+		if(position.y < low.y) low.y = position.y;
+		if(position.z < low.z) low.z = position.z;
+		if(position.x > high.x) high.x = position.x;
+		if(position.y > high.y) high.y = position.y;
+		if(position.z > high.z) high.z = position.z;
+	}
+	packed.position_offset = low;
+	packed.position_scale.x = (high.x - low.x)/65535.0f;
+	packed.position_scale.y = (high.y - low.y)/65535.0f;
+	packed.position_scale.z = (high.z - low.z)/65535.0f;
+
+	const float* offset = &packed.position_offset.x;
+	const float* scale = &packed.position_scale.x;
+	for(size_t i = 0; i < count; i++)
+	{
+		const MeshVertex& vertex = indexed.vertices[i];
+		const float* position = &vertex.position.x;
+		for(int axis = 0; axis < 3; axis++)
+		{
+			float steps = scale[axis] > 0 ? (position[axis] - offset[axis])/scale[axis] : 0;
+			if(steps > 65535) steps = 65535;
+			if(steps < 0) steps = 0;
+			packed.positions[i*3 + axis] = (unsigned short)(steps + 0.5f);
+		}
+
+		int u, v;
+		octEncode(vertex.normal, packed.normal_bits, u, v);
+		if(packed.normal_bits == 8)
+		{
+			packed.normals[i] = (unsigned short)((u & 0xff) | ((v & 0xff) << 8));
+		} else {
+			packed.normals[i*2] = (unsigned short)(u & 0xffff);
+			packed.normals[i*2 + 1] = (unsigned short)(v & 0xffff);
+		}
+
+		packed.tex_coords[i*2] = floatToHalf(vertex.tex_coord.x);
+		packed.tex_coords[i*2 + 1] = floatToHalf(vertex.tex_coord.y);
+	}
+
+	/* Measure what was lost against the welded full precision vertices */
+	IndexedMesh decoded;
+	unpackMesh(packed, decoded);
+	float positionError = 0, normalError = 0, uvError = 0;
+	for(size_t i = 0; i < count; i++)
+	{
+		const MeshVertex& a = indexed.vertices[i];
+		const MeshVertex& b = decoded.vertices[i];
+
+		float dx = fabs(a.position.x - b.position.x);
+		float dy = fabs(a.position.y - b.position.y);
+		float dz = fabs(a.position.z - b.position.z);
+		if(dx > positionError) positionError = dx;
+		if(dy > positionError) positionError = dy;
+		if(dz > positionError) positionError = dz;
+
+		float length = sqrt(a.normal.x*a.normal.x + a.normal.y*a.normal.y + a.normal.z*a.normal.z);
+		if(length > 0)
+		{
+			float cosine = (a.normal.x*b.normal.x + a.normal.y*b.normal.y + a.normal.z*b.normal.z)/length;
+			if(cosine > 1) cosine = 1;
+			float degrees = acos(cosine)*57.29578f;
+			if(degrees > normalError) normalError = degrees;
+		}
+
+		float du = fabs(a.tex_coord.x - b.tex_coord.x);
+		float dv = fabs(a.tex_coord.y - b.tex_coord.y);
+		if(du > uvError) uvError = du;
+		if(dv > uvError) uvError = dv;
+	}
+
+	float largestStep = scale[0] > scale[1] ? scale[0] : scale[1];
+	if(scale[2] > largestStep) largestStep = scale[2];
+	size_t indexBytes = packed.indices16.size()*2 + packed.indices32.size()*4;
+	size_t meshBytes = mesh.faces.size()*sizeof(Face) + mesh.vertices.size()*sizeof(Vector3f)
+		+ mesh.vertex_normals.size()*sizeof(Vector3f) + mesh.tex_coords.size()*sizeof(Vector2f);
+
+	printf("Packed mesh: %d vertices at %d bytes each (was %d), %d bytes in total (was %d as loaded)\n",
+		(int)count, packedVertexBytes(packed), (int)sizeof(MeshVertex),
+		(int)(count*packedVertexBytes(packed) + indexBytes), (int)meshBytes);
+	printf("Packed mesh error: position %g (quantisation step %g), normal %.3f degrees, tex coord %g\n",
+		positionError, largestStep, normalError, uvError);
+}
+
+void unpackMesh(const PackedMesh& packed, IndexedMesh& indexed)
+{
+	size_t count = packed.positions.size()/3;
+	indexed.vertices.resize(count);
+	if(packed.indices16.empty())
+		indexed.indices = packed.indices32;
+	else
+		indexed.indices.assign(packed.indices16.begin(), packed.indices16.end());
+
+	size_t i = 0;
+#ifdef MESHPACK_SSE2
+	/* Four vertices at a time: their twelve position components are three
+	   registers whose lanes cycle through x, y, z */
+	const float* o = &packed.position_offset.x;
+	const float* s = &packed.position_scale.x;
+	const __m128 offsets[3] = {
+		_mm_setr_ps(o[0], o[1], o[2], o[0]), _mm_setr_ps(o[1], o[2], o[0], o[1]), _mm_setr_ps(o[2], o[0], o[1], o[2])
+	};
+	const __m128 scales[3] = {
+		_mm_setr_ps(s[0], s[1], s[2], s[0]), _mm_setr_ps(s[1], s[2], s[0], s[1]), _mm_setr_ps(s[2], s[0], s[1], s[2])
+	};
+	const __m128i zero = _mm_setzero_si128();
+
+	for(; i + 4 <= count; i += 4)
+	{
+		float positions[12], nx[4], ny[4], nz[4], uv[8];
+
+		const unsigned short* source = &packed.positions[i*3];
+		__m128i first = _mm_loadu_si128((const __m128i*)source);       // components 0-7
+		__m128i last = _mm_loadl_epi64((const __m128i*)(source + 8));  // components 8-11
+		_mm_storeu_ps(positions, _mm_add_ps(offsets[0], _mm_mul_ps(scales[0], _mm_cvtepi32_ps(_mm_unpacklo_epi16(first, zero)))));
+		_mm_storeu_ps(positions + 4, _mm_add_ps(offsets[1], _mm_mul_ps(scales[1], _mm_cvtepi32_ps(_mm_unpackhi_epi16(first, zero)))));
+		_mm_storeu_ps(positions + 8, _mm_add_ps(offsets[2], _mm_mul_ps(scales[2], _mm_cvtepi32_ps(_mm_unpacklo_epi16(last, zero)))));
+
+		unpackNormals4(packed, i, nx, ny, nz);
+
+		__m128i halves = _mm_loadu_si128((const __m128i*)&packed.tex_coords[i*2]);
+		_mm_storeu_ps(uv, halfToFloat4(_mm_unpacklo_epi16(halves, zero)));
+		_mm_storeu_ps(uv + 4, halfToFloat4(_mm_unpackhi_epi16(halves, zero)));
+
+		for(int j = 0; j < 4; j++)
+		{
+			MeshVertex& vertex = indexed.vertices[i + j];
+			vertex.position.x = positions[j*3];
+			vertex.position.y = positions[j*3 + 1];
+			vertex.position.z = positions[j*3 + 2];
+			vertex.normal.x = nx[j];
+			vertex.normal.y = ny[j];
+			vertex.normal.z = nz[j];
+			vertex.tex_coord.x = uv[j*2];
+			vertex.tex_coord.y = uv[j*2 + 1];
+		}
+	}
+#endif
+
+	for(; i < count; i++)
+		unpackVertexScalar(packed, i, indexed.vertices[i]);
+}
+
+bool uploadPackedMesh(Mesh& mesh, int normalBits)
+{
+	std::shared_ptr<PackedMesh> packed(new PackedMesh);
+	packMesh(mesh, *packed, normalBits);
+
+	IndexedMesh indexed;
+	unpackMesh(*packed, indexed);
+	if(!uploadIndexedMesh(mesh, indexed))
+		return false;
+
+	size_t loadedBytes = mesh.faces.size()*sizeof(Face) + mesh.vertices.size()*sizeof(Vector3f)
+		+ mesh.vertex_normals.size()*sizeof(Vector3f) + mesh.tex_coords.size()*sizeof(Vector2f);
+	for(size_t i = 0; i < mesh.lod_indices.size(); i++)
+		loadedBytes += mesh.lod_indices[i].size()*sizeof(unsigned int);
+
+	/* Swapping with empty vectors gives the memory back, where clear() wouldn't.
+	   The detail levels are only needed for their index buffers, now filled */
+	std::vector<Face>().swap(mesh.faces);
+	std::vector<Vector3f>().swap(mesh.vertices);
+	std::vector<Vector3f>().swap(mesh.vertex_normals);
+	std::vector<Vector2f>().swap(mesh.tex_coords);
+	std::vector< std::vector<unsigned int> >().swap(mesh.lod_indices);
+	mesh.packed = packed;
+
+	printf("Mesh kept packed: %d bytes instead of %d as loaded\n", (int)packedMeshBytes(*packed), (int)loadedBytes);
+	return true;
+}
@@ -0,0 +1,51 @@
+/*
+ * meshpack.h
+ *
+ * Compact storage for welded meshes, for keeping many aircraft resident:
+ *   positions   3 x 16 bit, quantised against the mesh bounding box
+ *   normals     octahedral encoding, 2 x 8 or 2 x 16 bit
+ *   tex coords  2 x 16 bit half floats
+ *   indices     16 bit when the vertex count allows
+ * i.e. 12 or 14 bytes per vertex instead of 32. unpackMesh expands it back to
+ * MeshVertex with SSE2, which uploadPackedMesh uses to keep a mesh resident in
+ * this form.
+ */
+
+#ifndef MESHPACK_H_
+#define MESHPACK_H_
+
+#include <vector>
+#include "mesh.h"
+#include "meshbuffer.h"
+
+struct PackedMesh{
+	Vector3f position_offset; // position = offset + quantised*scale
+	Vector3f position_scale;
+	int normal_bits;          // 8 or 16
+
+	std::vector<unsigned short> positions;  // 3 per vertex
+	std::vector<unsigned short> normals;    // 1 per vertex (two signed bytes) or 2 per vertex (two signed shorts)
+	std::vector<unsigned short> tex_coords; // 2 half floats per vertex
+	std::vector<unsigned short> indices16;  // Used when there are at most 65536 vertices
+	std::vector<unsigned int> indices32;    // Used otherwise
+};
+
+//Welds and packs a mesh. Prints bytes per vertex and the largest position,
+//normal (degrees) and texture coordinate errors introduced
+void packMesh(const Mesh& mesh, PackedMesh& packed, int normalBits);
+
+//Expands a packed mesh back into full precision interleaved vertices
+void unpackMesh(const PackedMesh& packed, IndexedMesh& indexed);
+
+//Bytes used per vertex by the packed attribute streams
+int packedVertexBytes(const PackedMesh& packed);
+
+//Bytes held by all of a packed mesh's streams
+size_t packedMeshBytes(const PackedMesh& packed);
+
+//Packs mesh, uploads it (see uploadIndexedMesh) decoded from the packed form and
+//then keeps only that form, in mesh.packed, freeing the arrays it was loaded
+//into and the detail level index lists. Returns false, leaving the mesh as it was, if it can't be uploaded
+bool uploadPackedMesh(Mesh& mesh, int normalBits);
+
+#endif /* MESHPACK_H_ */
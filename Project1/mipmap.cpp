@@ -0,0 +1,372 @@
+/*
+ * mipmap.cpp
+ */
+
+#include "mipmap.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+	const char mipFileMagic[8] = {'M','I','P','T','E','X','\0','\0'};
+	const unsigned int mipFileVersion = 1;
+
+	struct MipFileLevel{
+		unsigned int width;
+		unsigned int height;
+		unsigned long long offset; // From the end of the header
+		unsigned long long size;
+	};
+
+	//Header of a .mip container, followed by the levels' pixels, largest first
+	struct MipFileHeader{
+		char magic[8];
+		unsigned int version;
+		unsigned int headerSize;
+		unsigned long long sourceSize; // Size of the image the levels were built from
+		unsigned long long sourceTime; // Modification time of that image
+		unsigned int channels;
+		unsigned int levels;
+		MipFileLevel level[MAX_MIP_LEVELS];
+	};
+
+	/* The power of two gluBuild2DMipmaps would pick: the nearest one, with
+	   three times a power of two rounding up */
+	int nearestPowerOfTwo(int value)
+	{
+		int power = 1;
+		if(value <= 0)
+			return 1;
+		for(;;)
+		{
+			if(value == 1)
+				return power;
+			if(value == 3)
+				return power*4;
+			value >>= 1;
+			power *= 2;
+		}
+	}
+
+	struct Tap{
+		int first; // First source sample
+		std::vector<float> weights;
+	};
+
+	/* Weights for resampling inLength samples to outLength: a box over each
+	   output sample's footprint when shrinking, linear interpolation when
+	   growing */
+	void getTaps(int inLength, int outLength, std::vector<Tap>& taps)
+	{
+		float scale = (float)inLength/outLength;
+		taps.resize(outLength);
+		for(int i = 0; i < outLength; i++)
+		{
+			Tap& tap = taps[i];
+			tap.weights.clear();
+			if(scale > 1)
+			{
+				float start = i*scale, end = (i + 1)*scale;
+				tap.first = (int)start;
+				for(int j = tap.first; j < inLength && j < end; j++)
+				{
+					float low = j > start ? (float)j : start;
+					float high = j + 1 < end ? (float)(j + 1) : end;
+					tap.weights.push_back((high - low)/scale);
+				}
+			} else {
+				float centre = (i + 0.5f)*scale - 0.5f;
+				if(centre < 0)
+					centre = 0;
+				tap.first = (int)centre;
+				float fraction = centre - tap.first;
+				if(tap.first + 1 >= inLength)
+				{
+					tap.first = inLength - 1;
+					tap.weights.push_back(1);
+				} else {
+					tap.weights.push_back(1 - fraction);
+					tap.weights.push_back(fraction);
+				}
+			}
+		}
+	}
+}
+
+void resizeImage(const unsigned char* in, int inWidth, int inHeight, int channels, unsigned char* out, int outWidth, int outHeight)
+{
+	std::vector<Tap> columns, rows;
+	getTaps(inWidth, outWidth, columns);
+	getTaps(inHeight, outHeight, rows);
+
+	/* Horizontal pass into floats, then vertical pass back to bytes */
+	std::vector<float> wide((size_t)outWidth*inHeight*channels);
+	for(int y = 0; y < inHeight; y++)
+	{
+		const unsigned char* row = in + (size_t)y*inWidth*channels;
+		float* target = &wide[(size_t)y*outWidth*channels];
+		for(int x = 0; x < outWidth; x++)
+		{
+			const Tap& tap = columns[x];
+			for(int c = 0; c < channels; c++)
+			{
+				float sum = 0;
+				for(size_t k = 0; k < tap.weights.size(); k++)
+					sum += tap.weights[k]*row[(tap.first + k)*channels + c];
+				target[x*channels + c] = sum;
+			}
+		}
+	}
+
+	size_t rowFloats = (size_t)outWidth*channels;
+	for(int y = 0; y < outHeight; y++)
+	{
+		const Tap& tap = rows[y];
+		unsigned char* target = out + y*rowFloats;
+		for(size_t i = 0; i < rowFloats; i++)
+		{
+			float sum = 0.5f;
+			for(size_t k = 0; k < tap.weights.size(); k++)
+				sum += tap.weights[k]*wide[(tap.first + k)*rowFloats + i];
+			target[i] = sum >= 255 ? 255 : (unsigned char)sum;
+		}
+	}
+}
+
+void halveImage(const unsigned char* in, int width, int height, int channels, unsigned char* out)
+{
+	int outWidth = width > 1 ? width/2 : 1;
+	int outHeight = height > 1 ? height/2 : 1;
+	int stepX = width > 1 ? channels : 0;
+	size_t stepY = height > 1 ? (size_t)width*channels : 0;
+
+	for(int y = 0; y < outHeight; y++)
+	{
+		const unsigned char* row = in + (size_t)y*(height > 1 ? 2 : 1)*width*channels;
+		for(int x = 0; x < outWidth; x++)
+		{
+			const unsigned char* p = row + (size_t)x*(width > 1 ? 2 : 1)*channels;
+			for(int c = 0; c < channels; c++)
+				*out++ = (unsigned char)((p[c] + p[c + stepX] + p[c + stepY] + p[c + stepY + stepX] + 2) >> 2);
+		}
+	}
+}
+
+std::string getMipFileName(const char* imageFilename)
+{
+	return std::string(imageFilename) + ".mip";
+}
+
+void buildMipChain(const Image& image, MipChain& chain)
+{
+	int width = nearestPowerOfTwo(image.width);
+	int height = nearestPowerOfTwo(image.height);
+
+	chain.channels = image.channels;
+	chain.levels.clear();
+
+	/* Lay the levels out first so the pixels are allocated once */
+	size_t total = 0;
+	for(int w = width, h = height; ; w = w > 1 ? w/2 : 1, h = h > 1 ? h/2 : 1)
+	{
+		MipLevel level;
+		level.width = w;
+		level.height = h;
+		level.offset = total;
+		level.size = (size_t)w*h*chain.channels;
+		chain.levels.push_back(level);
+		total += level.size;
+		if((w == 1 && h == 1) || chain.levels.size() == MAX_MIP_LEVELS)
+			break;
+	}
+	chain.pixels.resize(total);
+
+	if(width == image.width && height == image.height)
+		memcpy(&chain.pixels[0], image.pixels, chain.levels[0].size);
+	else
+		resizeImage((const unsigned char*)image.pixels, image.width, image.height, chain.channels, &chain.pixels[0], width, height);
+
+	for(size_t i = 1; i < chain.levels.size(); i++)
+	{
+		const MipLevel& above = chain.levels[i - 1];
+		halveImage(&chain.pixels[above.offset], above.width, above.height, chain.channels, &chain.pixels[chain.levels[i].offset]);
+	}
+}
+
+bool writeMipFile(const MipChain& chain, const char* filename, unsigned long long sourceSize, unsigned long long sourceTime)
+{
+	FILE* filePtr = fopen(filename, "wb");
+	if(filePtr == NULL)
+	{
+		printf("Could not write mipmap file %s\n", filename);
+		return false;
+	}
+
+	MipFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, mipFileMagic, sizeof(mipFileMagic));
+	header.version = mipFileVersion;
+	header.headerSize = sizeof(MipFileHeader);
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+	header.channels = chain.channels;
+	header.levels = (unsigned int)chain.levels.size();
+	for(unsigned int i = 0; i < header.levels; i++)
+	{
+		header.level[i].width = chain.levels[i].width;
+		header.level[i].height = chain.levels[i].height;
+		header.level[i].offset = chain.levels[i].offset;
+		header.level[i].size = chain.levels[i].size;
+	}
+
+	bool ok = fwrite(&header, sizeof(header), 1, filePtr) == 1
+		&& (chain.pixels.empty() || fwrite(&chain.pixels[0], chain.pixels.size(), 1, filePtr) == 1);
+	if(fclose(filePtr) != 0)
+		ok = false;
+
+	if(!ok)
+	{
+		printf("Could not write mipmap file %s\n", filename);
+		remove(filename);
+	}
+	return ok;
+}
+
+bool openMipFile(MipFile& mip, const char* filename, unsigned long long sourceSize, unsigned long long sourceTime)
+{
+	if(!openMappedFile(mip.file, filename))
+		return false;
+
+	MipFileHeader header;
+	bool valid = mip.file.size >= sizeof(MipFileHeader);
+	if(valid)
+	{
+		memcpy(&header, mip.file.data, sizeof(MipFileHeader));
+		valid = memcmp(header.magic, mipFileMagic, sizeof(mipFileMagic)) == 0
+			&& header.version == mipFileVersion
+			&& header.headerSize == sizeof(MipFileHeader)
+			&& header.sourceSize == sourceSize
+			&& header.sourceTime == sourceTime
+			&& (header.channels == 3 || header.channels == 4)
+			&& header.levels >= 1 && header.levels <= MAX_MIP_LEVELS;
+	}
+
+	/* Every level has to lie inside the file */
+	size_t dataSize = valid ? mip.file.size - sizeof(MipFileHeader) : 0;
+	for(unsigned int i = 0; valid && i < header.levels; i++)
+	{
+		const MipFileLevel& level = header.level[i];
+		valid = level.size == (unsigned long long)level.width*level.height*header.channels
+			&& level.offset <= dataSize && level.size <= dataSize - level.offset;
+		mip.levels[i].width = level.width;
+		mip.levels[i].height = level.height;
+		mip.levels[i].offset = (size_t)level.offset;
+		mip.levels[i].size = (size_t)level.size;
+	}
+
+	if(!valid)
+	{
+		closeMappedFile(mip.file);
+		return false;
+	}
+
+	mip.channels = header.channels;
+	mip.levelCount = header.levels;
+	mip.pixels = (const unsigned char*)mip.file.data + sizeof(MipFileHeader);
+	return true;
+}
+
+void closeMipFile(MipFile& mip)
+{
+	closeMappedFile(mip.file);
+	mip.pixels = NULL;
+	mip.levelCount = 0;
+}
+
+bool readTextureMips(TextureMips& mips, const char* imageFilename)
+{
+	mips.filename = imageFilename;
+	if(!getFileInfo(imageFilename, mips.sourceSize, mips.sourceTime))
+		return false;
+
+	std::string mipName = getMipFileName(imageFilename);
+	mips.mapped = openMipFile(mips.file, mipName.c_str(), mips.sourceSize, mips.sourceTime);
+	if(mips.mapped)
+		return true;
+
+	/* RGBA, so every row of every level is 4 byte aligned as GL_UNPACK_ALIGNMENT expects */
+	mips.image = loadBMP(imageFilename, true);
+	return mips.image != NULL;
+}
+
+void buildTextureMips(TextureMips& mips)
+{
+	if(mips.mapped)
+	{
+		mips.channels = mips.file.channels;
+		mips.levelCount = mips.file.levelCount;
+		mips.levels = mips.file.levels;
+		mips.pixels = mips.file.pixels;
+		return;
+	}
+	if(mips.image == NULL)
+		return;
+
+	buildMipChain(*mips.image, mips.chain);
+	delete mips.image;
+	mips.image = NULL;
+	writeMipFile(mips.chain, getMipFileName(mips.filename.c_str()).c_str(), mips.sourceSize, mips.sourceTime);
+
+	mips.channels = mips.chain.channels;
+	mips.levelCount = (int)mips.chain.levels.size();
+	mips.levels = &mips.chain.levels[0];
+	mips.pixels = &mips.chain.pixels[0];
+}
+
+bool loadTextureMips(TextureMips& mips, const char* imageFilename)
+{
+	if(!readTextureMips(mips, imageFilename))
+		return false;
+	buildTextureMips(mips);
+	return true;
+}
+
+void freeTextureMips(TextureMips& mips)
+{
+	if(mips.mapped)
+		closeMipFile(mips.file);
+	delete mips.image;
+	mips.image = NULL;
+	mips.mapped = false;
+	mips.chain.levels.clear();
+	mips.chain.pixels.clear();
+	mips.levelCount = 0;
+	mips.levels = NULL;
+	mips.pixels = NULL;
+}
+
+void moveTextureMips(TextureMips& from, TextureMips& to)
+{
+	freeTextureMips(to);
+	to.filename = from.filename;
+	to.sourceSize = from.sourceSize;
+	to.sourceTime = from.sourceTime;
+	to.mapped = from.mapped;
+	to.file = from.file;
+	to.image = from.image;
+	to.chain.channels = from.chain.channels;
+	to.chain.levels.swap(from.chain.levels);
+	to.chain.pixels.swap(from.chain.pixels);
+
+	/* Swapping keeps the chain's storage where it was, but the container's
+	   levels live inside the MipFile itself */
+	to.channels = from.channels;
+	to.levelCount = from.levelCount;
+	to.levels = from.mapped ? to.file.levels : from.levels;
+	to.pixels = from.pixels;
+
+	from.mapped = false;
+	from.image = NULL;
+	from.levelCount = 0;
+	from.levels = NULL;
+	from.pixels = NULL;
+}
@@ -0,0 +1,107 @@
+/*
+ * mipmap.h
+ *
+ * Builds a full mipmap chain for an image once, offline or on first use, and
+ * stores it in a small container file (filename + ".mip") so later runs can map
+ * it and hand each level straight to glTexImage2D instead of calling
+ * gluBuild2DMipmaps.
+ *
+ * Like gluBuild2DMipmaps, images are first resized to the nearest power of two
+ * in each direction, then each level is a 2x2 box filter of the one above.
+ */
+
+#ifndef MIPMAP_H_
+#define MIPMAP_H_
+
+#include <string>
+#include <vector>
+#include "imageloader.h"
+#include "platform.h"
+
+#define MAX_MIP_LEVELS 16
+
+struct MipLevel{
+	int width;
+	int height;
+	size_t offset; // Of the level's first byte in the pixel data
+	size_t size;
+};
+
+struct MipChain{
+	int channels; // 3 (RGB) or 4 (RGBA)
+	std::vector<MipLevel> levels; // Largest first, down to 1x1
+	std::vector<unsigned char> pixels;
+};
+
+//A container file mapped into memory. pixels + levels[i].offset is level i
+struct MipFile{
+	MappedFile file;
+	int channels;
+	int levelCount;
+	MipLevel levels[MAX_MIP_LEVELS];
+	const unsigned char* pixels;
+};
+
+//Name of the container for a source image
+std::string getMipFileName(const char* imageFilename);
+
+//Resizes image to power of two sides and builds every level below it
+void buildMipChain(const Image& image, MipChain& chain);
+
+//Resamples tightly packed pixels to outWidth x outHeight: a box filter when
+//shrinking, linear interpolation when growing
+void resizeImage(const unsigned char* in, int inWidth, int inHeight, int channels, unsigned char* out, int outWidth, int outHeight);
+
+//2x2 box filter into the next level down. A side that is already 1 stays 1
+//and only the other is halved
+void halveImage(const unsigned char* in, int width, int height, int channels, unsigned char* out);
+
+//Writes chain to a container, recording the source image's size and time so
+//stale containers can be detected. Returns false (leaving no file) on failure
+bool writeMipFile(const MipChain& chain, const char* filename, unsigned long long sourceSize, unsigned long long sourceTime);
+
+//Maps a container, checking it was made from a source of the given size and
+//time. Returns false if it's missing, stale or damaged
+bool openMipFile(MipFile& mip, const char* filename, unsigned long long sourceSize, unsigned long long sourceTime);
+
+void closeMipFile(MipFile& mip);
+
+//Everything needed to upload a texture's mipmaps, gathered without touching
+//OpenGL so it can be done on a worker thread. After buildTextureMips, pixels
+//and levels point into either the mapped container or the built chain
+struct TextureMips{
+	std::string filename;
+	unsigned long long sourceSize;
+	unsigned long long sourceTime;
+	bool mapped;  // A fresh container was found
+	MipFile file;
+	Image* image; // Otherwise the decoded bitmap, until the chain is built
+	MipChain chain;
+
+	int channels;
+	int levelCount;
+	const MipLevel* levels;
+	const unsigned char* pixels;
+
+	TextureMips() : sourceSize(0), sourceTime(0), mapped(false), image(NULL), channels(0), levelCount(0), levels(NULL), pixels(NULL) {}
+};
+
+//Maps the container for imageFilename if it's up to date, or decodes the bitmap
+//(as RGBA) if not. Returns false if neither can be read
+bool readTextureMips(TextureMips& mips, const char* imageFilename);
+
+//Builds and saves the chain for a decoded bitmap (if readTextureMips needed
+//one) and fills in pixels and levels
+void buildTextureMips(TextureMips& mips);
+
+//readTextureMips then buildTextureMips
+bool loadTextureMips(TextureMips& mips, const char* imageFilename);
+
+void freeTextureMips(TextureMips& mips);
+
+//Moves the pixels (and the mapping or chain holding them) into to, freeing
+//whatever to held and leaving from empty, so they can outlive the TextureMips
+//they were loaded into
+void moveTextureMips(TextureMips& from, TextureMips& to);
+
+#endif /* MIPMAP_H_ */
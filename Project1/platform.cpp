@@ -0,0 +1,239 @@
+/*
+ * platform.cpp
+ *
+ * Windows implementation using file mappings and the performance counter,
+ * with a POSIX fallback so the loaders also build with make_flightsim.
+ */
+
+#include "platform.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <ctype.h>
+#else
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#include <immintrin.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+bool cpuHasSSSE3(void)
+{
+	/* CPUID leaf 1 reports SSSE3 in bit 9 of ECX */
+#if defined(_M_IX86) || defined(_M_X64)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 9)) != 0;
+#elif defined(__i386__) || defined(__x86_64__)
+	unsigned int eax, ebx, ecx, edx;
+	if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return false;
+	return (ecx & (1 << 9)) != 0;
+#else
+	return false;
+#endif
+}
+
+bool cpuHasAVX(void)
+{
+	/* CPUID leaf 1 reports AVX in bit 28 of ECX and OS register saving
+	   (OSXSAVE) in bit 27; XCR0 then says whether the OS saves the YMM registers */
+#if defined(_M_IX86) || defined(_M_X64)
+	int info[4];
+	__cpuid(info, 1);
+	if((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+		return false;
+	return (_xgetbv(0) & 6) == 6;
+#elif defined(__i386__) || defined(__x86_64__)
+	unsigned int eax, ebx, ecx, edx;
+	if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return false;
+	if((ecx & (1 << 27)) == 0 || (ecx & (1 << 28)) == 0)
+		return false;
+	unsigned int xcr0, xcr0High;
+	__asm__("xgetbv" : "=a"(xcr0), "=d"(xcr0High) : "c"(0));
+	return (xcr0 & 6) == 6;
+#else
+	return false;
+#endif
+}
+
+#ifdef _WIN32
+
+bool openMappedFile(MappedFile& file, const char* filename)
+{
+	file.data = NULL;
+	file.size = 0;
+	file.fileHandle = NULL;
+	file.mapHandle = NULL;
+
+	HANDLE fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(fileHandle, &size))
+	{
+		CloseHandle(fileHandle);
+		return false;
+	}
+	file.fileHandle = fileHandle;
+	file.size = (size_t)size.QuadPart;
+
+	/* Windows refuses to map an empty file, so leave data as NULL */
+	if(file.size == 0)
+		return true;
+
+	HANDLE mapHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(mapHandle == NULL)
+	{
+		closeMappedFile(file);
+		return false;
+	}
+	file.mapHandle = mapHandle;
+
+	file.data = (const char*)MapViewOfFile(mapHandle, FILE_MAP_READ, 0, 0, 0);
+	if(file.data == NULL)
+	{
+		closeMappedFile(file);
+		return false;
+	}
+	return true;
+}
+
+void closeMappedFile(MappedFile& file)
+{
+	if(file.data != NULL)
+		UnmapViewOfFile(file.data);
+	if(file.mapHandle != NULL)
+		CloseHandle((HANDLE)file.mapHandle);
+	if(file.fileHandle != NULL)
+		CloseHandle((HANDLE)file.fileHandle);
+
+	file.data = NULL;
+	file.size = 0;
+	file.fileHandle = NULL;
+	file.mapHandle = NULL;
+}
+
+bool getFileInfo(const char* filename, unsigned long long& size, unsigned long long& modifiedTime)
+{
+	WIN32_FILE_ATTRIBUTE_DATA info;
+	if(!GetFileAttributesExA(filename, GetFileExInfoStandard, &info))
+		return false;
+
+	size = ((unsigned long long)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+	modifiedTime = ((unsigned long long)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+
+std::string getCanonicalPath(const char* filename)
+{
+	char path[MAX_PATH];
+	DWORD length = GetFullPathNameA(filename, MAX_PATH, path, NULL);
+	if(length == 0 || length >= MAX_PATH || GetFileAttributesA(path) == INVALID_FILE_ATTRIBUTES)
+		return filename;
+
+	/* NTFS names are case insensitive and either slash is accepted */
+	for(DWORD i = 0; i < length; i++)
+		path[i] = path[i] == '/' ? '\\' : (char)tolower((unsigned char)path[i]);
+	return std::string(path, length);
+}
+
+double getSeconds(void)
+{
+	static LARGE_INTEGER frequency = {0};
+	LARGE_INTEGER counter;
+
+	if(frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+
+	return (double)counter.QuadPart/(double)frequency.QuadPart;
+}
+
+#else
+
+bool openMappedFile(MappedFile& file, const char* filename)
+{
+	file.data = NULL;
+	file.size = 0;
+	file.fileHandle = NULL;
+	file.mapHandle = NULL;
+
+	int fd = open(filename, O_RDONLY);
+	if(fd < 0)
+		return false;
+
+	struct stat info;
+	if(fstat(fd, &info) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	file.size = (size_t)info.st_size;
+
+	if(file.size > 0)
+	{
+		void* data = mmap(NULL, file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(data == MAP_FAILED)
+		{
+			close(fd);
+			file.size = 0;
+			return false;
+		}
+		madvise(data, file.size, MADV_SEQUENTIAL);
+		file.data = (const char*)data;
+	}
+
+	/* The mapping stays valid once the descriptor is closed */
+	close(fd);
+	return true;
+}
+
+void closeMappedFile(MappedFile& file)
+{
+	if(file.data != NULL)
+		munmap((void*)file.data, file.size);
+
+	file.data = NULL;
+	file.size = 0;
+}
+
+bool getFileInfo(const char* filename, unsigned long long& size, unsigned long long& modifiedTime)
+{
+	struct stat info;
+	if(stat(filename, &info) != 0)
+		return false;
+
+	size = (unsigned long long)info.st_size;
+	modifiedTime = (unsigned long long)info.st_mtime;
+	return true;
+}
+
+std::string getCanonicalPath(const char* filename)
+{
+	char path[PATH_MAX];
+	if(realpath(filename, path) == NULL)
+		return filename;
+	return path;
+}
+
+double getSeconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec*1e-9;
+}
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ * platform.h
+ *
+ * Small operating system helpers shared by the loaders: read-only memory
+ * mapped files, canonical paths, a high resolution timer and CPU feature
+ * checks.
+ */
+
+#ifndef PLATFORM_H_
+#define PLATFORM_H_
+
+#include <stddef.h>
+#include <string>
+
+struct MappedFile{
+	const char* data; // Start of the mapped bytes (NULL for an empty file)
+	size_t size;      // Size of the file in bytes
+	void* fileHandle;
+	void* mapHandle;
+
+	MappedFile() : data(NULL), size(0), fileHandle(NULL), mapHandle(NULL) {}
+};
+
+//Maps a whole file read-only into memory. Returns false if it can't be opened
+bool openMappedFile(MappedFile& file, const char* filename);
+
+//Unmaps a file opened with openMappedFile
+void closeMappedFile(MappedFile& file);
+
+//Gets the size and last modification time of a file. Returns false if it doesn't exist
+bool getFileInfo(const char* filename, unsigned long long& size, unsigned long long& modifiedTime);
+
+//Returns an absolute, normalised path naming the same file as filename, so two
+//different spellings of one file compare equal. Returns filename unchanged if
+//it can't be resolved (for instance because it doesn't exist)
+std::string getCanonicalPath(const char* filename);
+
+//Returns a time in seconds from an arbitrary fixed point, for measuring intervals
+double getSeconds(void);
+
+//Whether the CPU running us supports SSSE3 (pshufb). Always false on non-x86
+bool cpuHasSSSE3(void);
+
+//Whether the CPU and operating system support AVX (256 bit float vectors).
+//Always false on non-x86
+bool cpuHasAVX(void);
+
+#endif /* PLATFORM_H_ */
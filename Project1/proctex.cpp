@@ -0,0 +1,285 @@
+/*
+ * proctex.cpp
+ */
+
+#include "proctex.h"
+#include "platform.h"
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define PROCTEX_SSE2
+#endif
+
+namespace {
+	struct ProcTextureCache{
+		std::mutex lock;
+		std::unordered_map<std::string, ProcTextureHandle> textures;
+	};
+
+	ProcTextureCache& getCache(void)
+	{
+		static ProcTextureCache* cache = new ProcTextureCache;
+		return *cache;
+	}
+
+	std::string getKey(const ProcTextureParams& params)
+	{
+		char key[256];
+		const unsigned char (*c)[3] = params.colours;
+		sprintf(key, "%d %d %u %d %d %d,%d,%d %d,%d,%d %d,%d,%d %g", (int)params.kind, params.size, params.seed, params.cells, params.octaves,
+			c[0][0], c[0][1], c[0][2], c[1][0], c[1][1], c[1][2], c[2][0], c[2][1], c[2][2], params.cover);
+		return key;
+	}
+
+	/* Random value in [0, 1) for a noise lattice point */
+	float latticeValue(unsigned int x, unsigned int y, unsigned int octave, unsigned int seed)
+	{
+		unsigned int h = seed ^ (x*0x8da6b343u) ^ (y*0xd8163841u) ^ (octave*0xcb1ab31fu);
+		h ^= h >> 13;
+		h *= 0x5bd1e995u;
+		h ^= h >> 15;
+		return (h & 0xffffff)/16777216.0f;
+	}
+
+	int wrap(int value, int period)
+	{
+		return ((value % period) + period) % period;
+	}
+
+	float smooth(float t)
+	{
+		return t*t*(3.0f - 2.0f*t);
+	}
+
+	/* One row of fractal value noise, 0 to 1. Each octave's lattice repeats
+	   across the texture a whole number of times, so the result tiles.
+	   lattice is scratch space */
+	void noiseRow(const ProcTextureParams& params, int y, float* row, std::vector<float>& lattice)
+	{
+		int size = params.size;
+		memset(row, 0, size*sizeof(float));
+		float amplitude = 0.5f, total = 0;
+
+		for(int octave = 0; octave < params.octaves; octave++)
+		{
+			int period = params.cells << octave;
+			float scale = (float)period/size;
+
+			/* Blend this octave's two lattice rows either side of y, with one
+			   column of wrap each side so x needs no wrapping of its own */
+			float fy = (y + 0.5f)*scale - 0.5f;
+			int y0 = fy < 0 ? -1 : (int)fy;
+			float ty = smooth(fy - y0);
+			int rowA = wrap(y0, period), rowB = wrap(y0 + 1, period);
+			lattice.resize(period + 2);
+			for(int c = -1; c <= period; c++)
+			{
+				float a = latticeValue(wrap(c, period), rowA, octave, params.seed);
+				float b = latticeValue(wrap(c, period), rowB, octave, params.seed);
+				lattice[c + 1] = a + (b - a)*ty;
+			}
+
+			/* Lattice column of pixel x is (x + 0.5)*scale - 0.5, plus one for the wrap column */
+			const float* values = &lattice[0];
+			float offset = 0.5f*scale + 0.5f;
+			int x = 0;
+#ifdef PROCTEX_SSE2
+			__m128 steps = _mm_set_ps(3*scale, 2*scale, scale, 0);
+			__m128 amplitudes = _mm_set1_ps(amplitude);
+			__m128 three = _mm_set1_ps(3.0f), two = _mm_set1_ps(2.0f);
+			for(; x + 4 <= size; x += 4)
+			{
+				__m128 fx = _mm_add_ps(_mm_set1_ps(x*scale + offset), steps);
+				__m128i column = _mm_cvttps_epi32(fx);
+				__m128 t = _mm_sub_ps(fx, _mm_cvtepi32_ps(column));
+				t = _mm_mul_ps(_mm_mul_ps(t, t), _mm_sub_ps(three, _mm_mul_ps(two, t)));
+
+				int columns[4];
+				_mm_storeu_si128((__m128i*)columns, column);
+				__m128 a = _mm_set_ps(values[columns[3]], values[columns[2]], values[columns[1]], values[columns[0]]);
+				__m128 b = _mm_set_ps(values[columns[3] + 1], values[columns[2] + 1], values[columns[1] + 1], values[columns[0] + 1]);
+				__m128 value = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+				_mm_storeu_ps(row + x, _mm_add_ps(_mm_loadu_ps(row + x), _mm_mul_ps(value, amplitudes)));
+			}
+#endif
+			for(; x < size; x++)
+			{
+				float fx = x*scale + offset;
+				int column = (int)fx;
+				float t = smooth(fx - column);
+				row[x] += amplitude*(values[column] + (values[column + 1] - values[column])*t);
+			}
+
+			total += amplitude;
+			amplitude *= 0.5f;
+		}
+
+		if(total > 0)
+			for(int x = 0; x < size; x++)
+				row[x] /= total;
+	}
+
+	/* Colours a row of RGBA pixels from weights: from + (to - from)*w, where
+	   w is the weight times scale plus bias, clamped to 0 to 1 */
+	void shadeRow(const float* weights, int width, float scale, float bias, const float* from, const float* to, unsigned char* out)
+	{
+		int x = 0;
+#ifdef PROCTEX_SSE2
+		__m128 scales = _mm_set1_ps(scale), biases = _mm_set1_ps(bias);
+		__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+		__m128 fromR = _mm_set1_ps(from[0]), fromG = _mm_set1_ps(from[1]), fromB = _mm_set1_ps(from[2]);
+		__m128 deltaR = _mm_set1_ps(to[0] - from[0]), deltaG = _mm_set1_ps(to[1] - from[1]), deltaB = _mm_set1_ps(to[2] - from[2]);
+		__m128i alpha = _mm_set1_epi32((int)0xff000000);
+		for(; x + 4 <= width; x += 4)
+		{
+			__m128 w = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(weights + x), scales), biases);
+			w = _mm_min_ps(_mm_max_ps(w, zero), one);
+
+			/* Weights in 0 to 1 keep every channel in 0 to 255, so they pack straight into bytes */
+			__m128i r = _mm_cvtps_epi32(_mm_add_ps(fromR, _mm_mul_ps(deltaR, w)));
+			__m128i g = _mm_cvtps_epi32(_mm_add_ps(fromG, _mm_mul_ps(deltaG, w)));
+			__m128i b = _mm_cvtps_epi32(_mm_add_ps(fromB, _mm_mul_ps(deltaB, w)));
+			__m128i pixels = _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)), _mm_or_si128(_mm_slli_epi32(b, 16), alpha));
+			_mm_storeu_si128((__m128i*)(out + x*4), pixels);
+		}
+#endif
+		for(; x < width; x++)
+		{
+			float w = weights[x]*scale + bias;
+			w = w < 0 ? 0 : (w > 1 ? 1 : w);
+			for(int c = 0; c < 3; c++)
+				out[x*4 + c] = (unsigned char)(from[c] + (to[c] - from[c])*w + 0.5f);
+			out[x*4 + 3] = 255;
+		}
+	}
+
+	void toFloats(const unsigned char* colour, float* out)
+	{
+		out[0] = colour[0];
+		out[1] = colour[1];
+		out[2] = colour[2];
+	}
+
+	/* Makes rows first to last - 1 of texture */
+	void makeRows(ProcTexture* texture, int first, int last)
+	{
+		const ProcTextureParams& params = texture->params;
+		int size = params.size;
+		std::vector<float> row(size), lattice;
+		float colours[3][3];
+		for(int i = 0; i < 3; i++)
+			toFloats(params.colours[i], colours[i]);
+
+		for(int y = first; y < last; y++)
+		{
+			unsigned char* out = &texture->pixels[(size_t)y*size*4];
+			switch(params.kind)
+			{
+				case procSky:
+				{
+					/* Horizon to zenith up the texture, with the noise above
+					   the cover threshold blended towards the cloud colour */
+					float t = (y + 0.5f)/size;
+					float base[3];
+					for(int c = 0; c < 3; c++)
+						base[c] = colours[0][c] + (colours[1][c] - colours[0][c])*t;
+					noiseRow(params, y, &row[0], lattice);
+					shadeRow(&row[0], size, 4.0f, -4.0f*(1.0f - params.cover), base, colours[2], out);
+					break;
+				}
+				case procGround:
+					/* Stretched, since averaging octaves leaves most values near the middle */
+					noiseRow(params, y, &row[0], lattice);
+					shadeRow(&row[0], size, 2.5f, -0.75f, colours[0], colours[1], out);
+					break;
+				case procChecker:
+				{
+					int rowCell = y*params.cells/size;
+					for(int x = 0; x < size; x++)
+					{
+						const unsigned char* colour = params.colours[((x*params.cells/size) ^ rowCell) & 1];
+						out[x*4] = colour[0];
+						out[x*4 + 1] = colour[1];
+						out[x*4 + 2] = colour[2];
+						out[x*4 + 3] = 255;
+					}
+					break;
+				}
+			}
+		}
+	}
+}
+
+ProcTextureParams::ProcTextureParams(ProcTextureKind kind, int size) : kind(kind), size(size), seed(1), cells(4), octaves(5), cover(0)
+{
+	static const unsigned char skyColours[3][3] = {{200, 220, 240}, {60, 110, 200}, {255, 255, 255}};
+	static const unsigned char groundColours[3][3] = {{60, 80, 30}, {140, 130, 80}, {0, 0, 0}};
+	static const unsigned char checkerColours[3][3] = {{255, 255, 255}, {0, 0, 0}, {0, 0, 0}};
+
+	switch(kind)
+	{
+		case procSky:
+			memcpy(colours, skyColours, sizeof(colours));
+			cover = 0.4f;
+			break;
+		case procGround:
+			memcpy(colours, groundColours, sizeof(colours));
+			seed = 2;
+			cells = 8;
+			octaves = 6;
+			break;
+		case procChecker:
+			memcpy(colours, checkerColours, sizeof(colours));
+			cells = 16;
+			octaves = 0;
+			break;
+	}
+}
+
+ProcTextureHandle getProcTexture(const ProcTextureParams& params, int threads)
+{
+	ProcTextureCache& cache = getCache();
+	std::string key = getKey(params);
+	{
+		std::lock_guard<std::mutex> guard(cache.lock);
+		std::unordered_map<std::string, ProcTextureHandle>::iterator found = cache.textures.find(key);
+		if(found != cache.textures.end())
+			return found->second;
+	}
+
+	/* Made outside the lock, so different textures can be made at once */
+	double startTime = getSeconds();
+	std::shared_ptr<ProcTexture> texture(new ProcTexture(params));
+	texture->pixels.resize((size_t)params.size*params.size*4);
+
+	if(threads < 1)
+		threads = 1;
+	if(threads > params.size)
+		threads = params.size;
+	std::vector<std::thread> workers;
+	for(int i = 1; i < threads; i++)
+		workers.push_back(std::thread(makeRows, texture.get(), params.size*i/threads, params.size*(i + 1)/threads));
+	makeRows(texture.get(), 0, params.size/threads);
+	for(size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	texture->buildTime = getSeconds() - startTime;
+
+	/* If another thread made the same texture meanwhile, keep the first */
+	std::lock_guard<std::mutex> guard(cache.lock);
+	ProcTextureHandle& entry = cache.textures[key];
+	if(!entry)
+		entry = texture;
+	return entry;
+}
+
+void clearProcTextureCache(void)
+{
+	ProcTextureCache& cache = getCache();
+	std::lock_guard<std::mutex> guard(cache.lock);
+	cache.textures.clear();
+}
@@ -0,0 +1,50 @@
+/*
+ * proctex.h
+ *
+ * Textures generated at startup instead of read from disk: a sky gradient with
+ * clouds, a ground of tiling noise and a checker. They're made at whatever size
+ * is asked for, split across threads by rows and four pixels at a time with
+ * SSE2 where available. Each one is kept in memory once made, so asking again
+ * with the same parameters returns it straight away.
+ */
+
+#ifndef PROCTEX_H_
+#define PROCTEX_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+enum ProcTextureKind {procSky, procGround, procChecker};
+
+struct ProcTextureParams{
+	ProcTextureKind kind;
+	int size;                    // Pixels across (it's square)
+	unsigned int seed;           // Picks the noise
+	int cells;                   // Checker squares across, or noise cells across the first octave
+	int octaves;                 // Layers of noise, each twice as fine and half as strong as the last
+	unsigned char colours[3][3]; // Sky: horizon, zenith, clouds. Ground: dark, light. Checker: the two squares
+	float cover;                 // Sky only: how much of it is cloud, 0 to 1
+
+	//Defaults that look like the bitmaps they replace
+	ProcTextureParams(ProcTextureKind kind, int size);
+};
+
+struct ProcTexture{
+	ProcTextureParams params;
+	std::vector<unsigned char> pixels; // RGBA, bottom row first
+	double buildTime;                  // Seconds it took to make
+
+	ProcTexture(const ProcTextureParams& params) : params(params), buildTime(0) {}
+};
+
+typedef std::shared_ptr<const ProcTexture> ProcTextureHandle;
+
+//Returns the texture for params, making it with up to threads threads if it
+//hasn't been made before. Noise textures tile: opposite edges match
+ProcTextureHandle getProcTexture(const ProcTextureParams& params, int threads = 1);
+
+//Frees every texture that isn't still held elsewhere
+void clearProcTextureCache(void);
+
+#endif /* PROCTEX_H_ */
@@ -0,0 +1,188 @@
+/*
+ * ringbench.cpp
+ *
+ * Times stepRings on a made-up level with a great many rings, most of them
+ * moving, with and without AVX, and checks both against the per-ring rules
+ * moveRings used to follow. Those rules are also timed on the linked list of
+ * separately allocated rings moveRings used to walk.
+ *
+ *   ringbench [rings] [steps]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "platform.h"
+#include "rings.h"
+
+#define DEFAULT_RINGS 1000000
+#define DEFAULT_STEPS 200
+
+namespace {
+	struct Ring{
+		float y, z, angle;
+		int movement;
+		int direction;
+	};
+
+	/* A ring as the game used to keep them, each one malloc'd */
+	struct ListRing{
+		float x, y, z;
+		float angle;
+		int movement;
+		int direction;
+		ListRing* next;
+	};
+
+	/* The old rules for one ring */
+	template<class AnyRing>
+	void stepRing(AnyRing& ring, const RingLimits& limits)
+	{
+		if(ring.movement == still)
+			return;
+		else if(ring.movement == horizontal)
+		{
+			if(ring.direction)
+			{
+				ring.z += limits.step;
+				if(ring.z > limits.maxZ)
+					ring.direction = 0;
+			} else {
+				ring.z -= limits.step;
+				if(ring.z < limits.minZ)
+					ring.direction = 1;
+			}
+		} else if(ring.movement == vertical) {
+			if(ring.direction)
+			{
+				ring.y += limits.step;
+				if(ring.y > limits.maxY)
+					ring.direction = 0;
+			} else {
+				ring.y -= limits.step;
+				if(ring.y < limits.minY)
+					ring.direction = 1;
+			}
+		} else if(ring.movement == spinClock) {
+			ring.angle += limits.spin;
+			if(ring.angle >= 360.0)
+				ring.angle -= 360.0;
+		} else {
+			ring.angle -= limits.spin;
+			if(ring.angle <= -360.0)
+				ring.angle += 360.0;
+		}
+	}
+
+	/* The old loop, one ring at a time */
+	void stepReference(std::vector<Ring>& rings, int first, const RingLimits& limits)
+	{
+		for(size_t i = first; i < rings.size(); i++)
+			stepRing(rings[i], limits);
+	}
+
+	/* The old moveRings, following next pointers from the current ring */
+	void stepList(ListRing* first, const RingLimits& limits)
+	{
+		for(ListRing* ring = first; ring != NULL; ring = ring->next)
+			stepRing(*ring, limits);
+	}
+
+	int countListDifferences(const std::vector<Ring>& reference, const ListRing* list)
+	{
+		int differences = 0;
+		for(size_t i = 0; i < reference.size(); i++, list = list->next)
+		{
+			const Ring& ring = reference[i];
+			if(ring.y != list->y || ring.z != list->z || ring.angle != list->angle || (ring.direction != 0) != (list->direction != 0))
+				differences++;
+		}
+		return differences;
+	}
+
+
+	int countDifferences(const std::vector<Ring>& reference, const RingStore& rings)
+	{
+		int differences = 0;
+		for(int i = 0; i < rings.count; i++)
+		{
+			int slot = rings.slot[i];
+			const Ring& ring = reference[i];
+			if(ring.y != rings.y[slot] || ring.z != rings.z[slot] || ring.angle != rings.angle[slot] || (ring.direction != 0) != (rings.direction[slot] != 0))
+				differences++;
+		}
+		return differences;
+	}
+
+	double timeSteps(void (*step)(RingStore&, int, const RingLimits&), RingStore& rings, int first, const RingLimits& limits, int steps)
+	{
+		double startTime = getSeconds();
+		for(int i = 0; i < steps; i++)
+			step(rings, first, limits);
+		return (getSeconds() - startTime)/steps;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int count = argc > 1 ? atoi(argv[1]) : DEFAULT_RINGS;
+	int steps = argc > 2 ? atoi(argv[2]) : DEFAULT_STEPS;
+	if(count < 1 || steps < 1)
+	{
+		fputs("Usage: ringbench [rings] [steps]\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	/* A mix like the bundled levels but mostly moving, in a 4 wide, 15 high room */
+	RingLimits limits = {1.5f, 13.5f, -4.5f, 4.5f, 0.1f, 1.0f};
+	RingStore rings;
+	std::vector<Ring> reference(count);
+	std::vector<ListRing*> list(count);
+	std::vector<void*> scatter(count); // Other allocations made between the list's, as the game's were
+	srand(1);
+	for(int i = 0; i < count; i++)
+	{
+		ringMovement movement = (ringMovement)(rand() % RING_MOVEMENTS);
+		float y = 1.5f + (rand() % 120)*0.1f, z = -4.5f + (rand() % 90)*0.1f;
+		addRing(rings, (float)i, y, z, movement);
+		Ring ring = {y, z, 0, movement, 1};
+		reference[i] = ring;
+
+		ListRing listRing = {(float)i, y, z, 0, movement, 1, NULL};
+		list[i] = (ListRing*)malloc(sizeof(ListRing));
+		*list[i] = listRing;
+		if(i > 0)
+			list[i - 1]->next = list[i];
+		scatter[i] = malloc(16 + rand() % 256);
+	}
+	groupRings(rings);
+
+	RingStore scalarRings;
+	copyRings(rings, scalarRings);
+
+	/* Start a tenth of the way in, as if those rings had been flown through */
+	int first = count/10;
+	double scalarTime = timeSteps(stepRingsScalar, scalarRings, first, limits, steps);
+	double vectorTime = timeSteps(stepRings, rings, first, limits, steps);
+	double startTime = getSeconds();
+	for(int i = 0; i < steps; i++)
+		stepReference(reference, first, limits);
+	double referenceTime = (getSeconds() - startTime)/steps;
+	startTime = getSeconds();
+	for(int i = 0; i < steps; i++)
+		stepList(list[first], limits);
+	double listTime = (getSeconds() - startTime)/steps;
+
+	printf("%d rings, %d steps from ring %d\n", count, steps, first);
+	printf("Linked list: %.3f ms a step, %d rings differ\n", listTime*1000, countListDifferences(reference, list[0]));
+	printf("Per ring loop: %.3f ms a step\n", referenceTime*1000);
+	printf("Grouped, scalar: %.3f ms a step, %d rings differ\n", scalarTime*1000, countDifferences(reference, scalarRings));
+	printf("Grouped, %s: %.3f ms a step, %d rings differ\n", cpuHasAVX() ? "AVX" : "no AVX on this CPU", vectorTime*1000, countDifferences(reference, rings));
+
+	for(int i = 0; i < count; i++)
+	{
+		free(list[i]);
+		free(scatter[i]);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,466 @@
+/*
+ * rings.cpp
+ */
+
+#include "rings.h"
+#include "arena.h"
+#include "platform.h"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#define RINGS_AVX
+/* GCC only emits AVX instructions in functions marked for it; the kernels
+   are only called once cpuHasAVX says they're safe */
+#if defined(__GNUC__) && !defined(__AVX__)
+#define TARGET_AVX __attribute__((target("avx")))
+#else
+#define TARGET_AVX
+#endif
+#endif
+
+namespace {
+	const size_t arrayBytes[] = {sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(unsigned int), sizeof(int), sizeof(int), 1};
+	const int arrayCount = sizeof(arrayBytes)/sizeof(arrayBytes[0]);
+
+	//One block big enough for every array, with room to align each
+	size_t blockSize(int capacity)
+	{
+		size_t size = 0;
+		for(int i = 0; i < arrayCount; i++)
+			size += capacity*arrayBytes[i] + RING_ALIGNMENT;
+		return size;
+	}
+
+	unsigned char* alignUp(unsigned char* p)
+	{
+		return (unsigned char*)(((size_t)p + RING_ALIGNMENT - 1) & ~(size_t)(RING_ALIGNMENT - 1));
+	}
+
+	//Points the arrays into rings.block, each aligned
+	void layOut(RingStore& rings)
+	{
+		void** arrays[] = {(void**)&rings.x, (void**)&rings.y, (void**)&rings.z, (void**)&rings.angle,
+			(void**)&rings.direction, (void**)&rings.ring, (void**)&rings.slot, (void**)&rings.movement};
+		unsigned char* p = (unsigned char*)rings.block;
+		for(int i = 0; i < arrayCount; i++)
+		{
+			p = alignUp(p);
+			*arrays[i] = p;
+			p += rings.capacity*arrayBytes[i];
+		}
+	}
+
+	//Gives rings a block for capacity rings from its arena or the heap
+	void allocBlock(RingStore& rings, int capacity)
+	{
+		rings.capacity = capacity;
+		rings.block = rings.arena != NULL ? arenaAlloc(*rings.arena, blockSize(capacity)) : malloc(blockSize(capacity));
+		layOut(rings);
+	}
+
+	//Frees rings' block unless its arena owns it
+	void freeBlock(RingStore& rings)
+	{
+		if(rings.arena == NULL)
+			free(rings.block);
+		rings.block = NULL;
+	}
+
+	//Copies every ring, the slots they're in and the grouping
+	void copyContents(const RingStore& from, RingStore& to)
+	{
+		int slots = from.slotsUsed;
+		memcpy(to.x, from.x, slots*sizeof(float));
+		memcpy(to.y, from.y, slots*sizeof(float));
+		memcpy(to.z, from.z, slots*sizeof(float));
+		memcpy(to.angle, from.angle, slots*sizeof(float));
+		memcpy(to.direction, from.direction, slots*sizeof(unsigned int));
+		memcpy(to.ring, from.ring, slots*sizeof(int));
+		memcpy(to.movement, from.movement, slots);
+		memcpy(to.slot, from.slot, from.count*sizeof(int));
+		to.count = from.count;
+		to.slotsUsed = slots;
+		to.grouped = from.grouped;
+		memcpy(to.groupStart, from.groupStart, sizeof(to.groupStart));
+		memcpy(to.groupEnd, from.groupEnd, sizeof(to.groupEnd));
+	}
+
+	//Hands from's arrays to to, leaving from empty
+	void takeBlock(RingStore& from, RingStore& to)
+	{
+		freeBlock(to);
+		to.block = from.block;
+		to.capacity = from.capacity;
+		from.block = NULL;
+		from.capacity = 0;
+		layOut(to);
+	}
+
+	//Moves count slots from one place to another, which may overlap
+	void moveSlots(RingStore& rings, int from, int to, int count)
+	{
+		memmove(rings.x + to, rings.x + from, count*sizeof(float));
+		memmove(rings.y + to, rings.y + from, count*sizeof(float));
+		memmove(rings.z + to, rings.z + from, count*sizeof(float));
+		memmove(rings.angle + to, rings.angle + from, count*sizeof(float));
+		memmove(rings.direction + to, rings.direction + from, count*sizeof(unsigned int));
+		memmove(rings.ring + to, rings.ring + from, count*sizeof(int));
+		memmove(rings.movement + to, rings.movement + from, count);
+	}
+
+	//First slot from start to end holding a ring at or after first. Rings in a
+	//group are in flying order, so the ones still to move are at its end
+	int firstToMove(const RingStore& rings, int start, int end, int first)
+	{
+		return (int)(std::lower_bound(rings.ring + start, rings.ring + end, first) - rings.ring);
+	}
+
+	/* The scalar kernels do what the old per-ring loop did for one movement */
+	void bounce(float* position, unsigned int* direction, int start, int end, float step, float low, float high)
+	{
+		for(int i = start; i < end; i++)
+		{
+			if(direction[i])
+			{
+				position[i] += step;
+				if(position[i] > high)
+					direction[i] = 0;
+			} else {
+				position[i] -= step;
+				if(position[i] < low)
+					direction[i] = ~0u;
+			}
+		}
+	}
+
+	void spin(float* angle, int start, int end, float step, bool clockwise)
+	{
+		if(clockwise)
+		{
+			for(int i = start; i < end; i++)
+			{
+				angle[i] += step;
+				if(angle[i] >= 360.0f)
+					angle[i] -= 360.0f;
+			}
+		} else {
+			for(int i = start; i < end; i++)
+			{
+				angle[i] -= step;
+				if(angle[i] <= -360.0f)
+					angle[i] += 360.0f;
+			}
+		}
+	}
+
+#ifdef RINGS_AVX
+	/* The AVX kernels give the same results bit for bit: adding -step is
+	   exactly subtracting step, and the turns and wraps are blends on the
+	   same comparisons, with NaNs going the same way */
+	TARGET_AVX void bounceAVX(float* position, unsigned int* direction, int start, int end, float step, float low, float high)
+	{
+		__m256 ups = _mm256_set1_ps(step), downs = _mm256_set1_ps(-step);
+		__m256 lows = _mm256_set1_ps(low), highs = _mm256_set1_ps(high);
+		int i = start;
+		for(; i + 8 <= end; i += 8)
+		{
+			__m256 up = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)(direction + i)));
+			__m256 moved = _mm256_add_ps(_mm256_loadu_ps(position + i), _mm256_blendv_ps(downs, ups, up));
+
+			/* Going up, keep going unless past high; going down, turn once past low */
+			__m256 stillUp = _mm256_cmp_ps(moved, highs, _CMP_NGT_UQ);
+			__m256 turnUp = _mm256_cmp_ps(moved, lows, _CMP_LT_OQ);
+			_mm256_storeu_ps(position + i, moved);
+			_mm256_storeu_si256((__m256i*)(direction + i), _mm256_castps_si256(_mm256_blendv_ps(turnUp, stillUp, up)));
+		}
+		bounce(position, direction, i, end, step, low, high);
+	}
+
+	TARGET_AVX void spinAVX(float* angle, int start, int end, float step, bool clockwise)
+	{
+		__m256 steps = _mm256_set1_ps(clockwise ? step : -step);
+		__m256 limits = _mm256_set1_ps(clockwise ? 360.0f : -360.0f);
+		__m256 zero = _mm256_setzero_ps();
+		int i = start;
+		for(; i + 8 <= end; i += 8)
+		{
+			__m256 turned = _mm256_add_ps(_mm256_loadu_ps(angle + i), steps);
+			__m256 past = clockwise ? _mm256_cmp_ps(turned, limits, _CMP_GE_OQ) : _mm256_cmp_ps(turned, limits, _CMP_LE_OQ);
+			_mm256_storeu_ps(angle + i, _mm256_sub_ps(turned, _mm256_blendv_ps(zero, limits, past)));
+		}
+		spin(angle, i, end, step, clockwise);
+	}
+#endif
+
+	void step(RingStore& rings, int first, const RingLimits& limits, bool avx)
+	{
+		if(!rings.grouped)
+			groupRings(rings);
+
+		int start[RING_MOVEMENTS], end[RING_MOVEMENTS];
+		for(int movement = horizontal; movement < RING_MOVEMENTS; movement++)
+		{
+			end[movement] = rings.groupEnd[movement];
+			start[movement] = firstToMove(rings, rings.groupStart[movement], end[movement], first);
+		}
+
+#ifdef RINGS_AVX
+		if(avx)
+		{
+			bounceAVX(rings.z, rings.direction, start[horizontal], end[horizontal], limits.step, limits.minZ, limits.maxZ);
+			bounceAVX(rings.y, rings.direction, start[vertical], end[vertical], limits.step, limits.minY, limits.maxY);
+			spinAVX(rings.angle, start[spinClock], end[spinClock], limits.spin, true);
+			spinAVX(rings.angle, start[spinAntiClock], end[spinAntiClock], limits.spin, false);
+			return;
+		}
+#endif
+		bounce(rings.z, rings.direction, start[horizontal], end[horizontal], limits.step, limits.minZ, limits.maxZ);
+		bounce(rings.y, rings.direction, start[vertical], end[vertical], limits.step, limits.minY, limits.maxY);
+		spin(rings.angle, start[spinClock], end[spinClock], limits.spin, true);
+		spin(rings.angle, start[spinAntiClock], end[spinAntiClock], limits.spin, false);
+	}
+
+	//Drops the first count rings of grouped rings and lays the groups out again
+	//in the same order, keeping room[m] free slots after group m and sharing
+	//out whatever's left evenly. The arrays must have room for it all
+	void shareRoom(RingStore& rings, int count, const int room[RING_MOVEMENTS])
+	{
+		/* Rings in a group are in flying order, so the ones dropped are at its start */
+		int from[RING_MOVEMENTS], kept[RING_MOVEMENTS], to[RING_MOVEMENTS];
+		int total = 0;
+		for(int movement = 0; movement < RING_MOVEMENTS; movement++)
+		{
+			from[movement] = firstToMove(rings, rings.groupStart[movement], rings.groupEnd[movement], count);
+			kept[movement] = rings.groupEnd[movement] - from[movement];
+			total += kept[movement];
+		}
+		int spare = rings.capacity - total;
+		for(int movement = 0; movement < RING_MOVEMENTS; movement++)
+			spare -= room[movement];
+		spare /= RING_MOVEMENTS;
+		int start = 0;
+		for(int movement = 0; movement < RING_MOVEMENTS; movement++)
+		{
+			to[movement] = start;
+			start += kept[movement] + room[movement] + spare;
+		}
+
+		/* Groups keep their order, so moving the ones going right last first and
+		   then the ones going left first first never overwrites a group before
+		   it has moved */
+		for(int movement = RING_MOVEMENTS - 1; movement >= 0; movement--)
+			if(to[movement] > from[movement])
+				moveSlots(rings, from[movement], to[movement], kept[movement]);
+		for(int movement = 0; movement < RING_MOVEMENTS; movement++)
+			if(to[movement] < from[movement])
+				moveSlots(rings, from[movement], to[movement], kept[movement]);
+
+		for(int movement = 0; movement < RING_MOVEMENTS; movement++)
+		{
+			rings.groupStart[movement] = to[movement];
+			rings.groupEnd[movement] = to[movement] + kept[movement];
+			for(int slot = rings.groupStart[movement]; slot < rings.groupEnd[movement]; slot++)
+			{
+				rings.ring[slot] -= count;
+				rings.slot[rings.ring[slot]] = slot;
+			}
+		}
+		rings.groupStart[RING_MOVEMENTS] = rings.slotsUsed = start;
+		rings.count -= count;
+	}
+}
+
+RingStore::RingStore(Arena* arena) : count(0), capacity(0), slotsUsed(0), x(0), y(0), z(0), angle(0), direction(0), movement(0), ring(0), slot(0),
+	grouped(true), block(0), arena(arena)
+{
+	memset(groupStart, 0, sizeof(groupStart));
+	memset(groupEnd, 0, sizeof(groupEnd));
+}
+
+RingStore::~RingStore()
+{
+	freeBlock(*this);
+}
+
+void reserveRings(RingStore& rings, int capacity)
+{
+	if(capacity <= rings.capacity)
+		return;
+
+	RingStore grown(rings.arena);
+	allocBlock(grown, capacity);
+	copyContents(rings, grown);
+	takeBlock(grown, rings);
+}
+
+void reserveRingGroups(RingStore& rings, const int counts[RING_MOVEMENTS])
+{
+	int total = 0;
+	for(int movement = 0; movement < RING_MOVEMENTS; movement++)
+		total += counts[movement];
+	emptyRings(rings);
+	reserveRings(rings, total);
+
+	total = 0;
+	for(int movement = 0; movement < RING_MOVEMENTS; movement++)
+	{
+		rings.groupStart[movement] = rings.groupEnd[movement] = total;
+		total += counts[movement];
+	}
+	rings.groupStart[RING_MOVEMENTS] = rings.slotsUsed = total;
+}
+
+int addRing(RingStore& rings, float x, float y, float z, ringMovement movement)
+{
+	/* Straight into its group if there's room kept for it, else after every slot in use */
+	int slot;
+	if(rings.grouped && rings.groupEnd[movement] < rings.groupStart[movement + 1])
+	{
+		slot = rings.groupEnd[movement]++;
+	} else {
+		if(rings.slotsUsed == rings.capacity)
+			reserveRings(rings, rings.capacity < 8 ? 8 : rings.capacity*2);
+		slot = rings.slotsUsed++;
+		rings.grouped = false;
+	}
+
+	int ring = rings.count++;
+	rings.x[slot] = x;
+	rings.y[slot] = y;
+	rings.z[slot] = z;
+	rings.angle[slot] = 0;
+	rings.direction[slot] = ~0u;
+	rings.movement[slot] = (unsigned char)movement;
+	rings.ring[slot] = ring;
+	rings.slot[ring] = slot;
+	return ring;
+}
+
+void groupRings(RingStore& rings)
+{
+	if(rings.grouped)
+		return;
+
+	/* Counting sort, taking the rings in flying order so each group keeps it */
+	RingStore sorted(rings.arena);
+	allocBlock(sorted, rings.count);
+
+	int next[RING_MOVEMENTS] = {0};
+	for(int ring = 0; ring < rings.count; ring++)
+		next[rings.movement[rings.slot[ring]]]++;
+	for(int movement = 0, start = 0; movement < RING_MOVEMENTS; movement++)
+	{
+		sorted.groupStart[movement] = start;
+		start += next[movement];
+		next[movement] = sorted.groupStart[movement];
+	}
+	sorted.groupStart[RING_MOVEMENTS] = rings.count;
+
+	for(int ring = 0; ring < rings.count; ring++)
+	{
+		int from = rings.slot[ring];
+		int to = next[rings.movement[from]]++;
+		sorted.x[to] = rings.x[from];
+		sorted.y[to] = rings.y[from];
+		sorted.z[to] = rings.z[from];
+		sorted.angle[to] = rings.angle[from];
+		sorted.direction[to] = rings.direction[from];
+		sorted.movement[to] = rings.movement[from];
+		sorted.ring[to] = ring;
+		sorted.slot[ring] = to;
+	}
+
+	rings.grouped = true;
+	rings.slotsUsed = rings.count;
+	memcpy(rings.groupStart, sorted.groupStart, sizeof(rings.groupStart));
+	memcpy(rings.groupEnd, sorted.groupStart + 1, sizeof(rings.groupEnd));
+	takeBlock(sorted, rings);
+}
+
+void recycleRings(RingStore& rings, int count)
+{
+	groupRings(rings);
+	const int noRoom[RING_MOVEMENTS] = {0};
+	shareRoom(rings, count, noRoom);
+}
+
+void reserveRingRoom(RingStore& rings, const int counts[RING_MOVEMENTS])
+{
+	groupRings(rings);
+
+	int needed = rings.count;
+	bool fits = true;
+	for(int movement = 0; movement < RING_MOVEMENTS; movement++)
+	{
+		needed += counts[movement];
+		if(counts[movement] > getRingRoom(rings, (ringMovement)movement))
+			fits = false;
+	}
+	if(fits)
+		return;
+
+	/* Doubling keeps the cost of growing spread thin over all the rings added */
+	if(needed > rings.capacity)
+		reserveRings(rings, needed > rings.capacity*2 ? needed : rings.capacity*2);
+	shareRoom(rings, 0, counts);
+}
+
+int getRingRoom(const RingStore& rings, ringMovement movement)
+{
+	return rings.grouped ? rings.groupStart[movement + 1] - rings.groupEnd[movement] : 0;
+}
+
+void copyRings(const RingStore& from, RingStore& to)
+{
+	emptyRings(to);
+	reserveRings(to, from.slotsUsed);
+	copyContents(from, to);
+}
+
+void swapRings(RingStore& a, RingStore& b)
+{
+	std::swap(a.count, b.count);
+	std::swap(a.capacity, b.capacity);
+	std::swap(a.slotsUsed, b.slotsUsed);
+	std::swap(a.grouped, b.grouped);
+	for(int movement = 0; movement < RING_MOVEMENTS; movement++)
+	{
+		std::swap(a.groupStart[movement], b.groupStart[movement]);
+		std::swap(a.groupEnd[movement], b.groupEnd[movement]);
+	}
+	std::swap(a.groupStart[RING_MOVEMENTS], b.groupStart[RING_MOVEMENTS]);
+	std::swap(a.block, b.block);
+	std::swap(a.arena, b.arena);
+	layOut(a);
+	layOut(b);
+}
+
+void emptyRings(RingStore& rings)
+{
+	rings.count = rings.slotsUsed = 0;
+	rings.grouped = true;
+	memset(rings.groupStart, 0, sizeof(rings.groupStart));
+	memset(rings.groupEnd, 0, sizeof(rings.groupEnd));
+}
+
+void clearRings(RingStore& rings)
+{
+	freeBlock(rings);
+	rings.capacity = 0;
+	layOut(rings);
+	emptyRings(rings);
+}
+
+void stepRings(RingStore& rings, int first, const RingLimits& limits)
+{
+	static const bool avx = cpuHasAVX();
+	step(rings, first, limits, avx);
+}
+
+void stepRingsScalar(RingStore& rings, int first, const RingLimits& limits)
+{
+	step(rings, first, limits, false);
+}
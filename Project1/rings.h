@@ -0,0 +1,122 @@
+/*
+ * rings.h
+ *
+ * The rings of a level, stored as a structure of arrays: every ring's x, y, z,
+ * angle, movement and direction sit in their own array, so moving the rings
+ * walks each array from front to back.
+ *
+ * Once grouped, the arrays hold all the still rings, then all the horizontal
+ * ones, and so on, each group in the order the rings are flown through. Each
+ * group is then moved by one kernel with no per-ring branches, eight rings at a
+ * time with AVX. A ring's place in the arrays is its slot, and slot[] maps the
+ * order the rings are flown through onto slots.
+ *
+ * All the arrays live in one allocation, each starting on a 32 byte boundary,
+ * taken from the heap or from an arena (see arena.h) that owns it.
+ */
+
+#ifndef RINGS_H_
+#define RINGS_H_
+
+#include <stddef.h>
+
+#define RING_ALIGNMENT 32 // Bytes
+
+struct Arena;
+
+enum ringMovement
+{
+	still,
+	horizontal,
+	vertical,
+	spinClock,
+	spinAntiClock,
+	RING_MOVEMENTS
+};
+
+struct RingStore{
+	int count;
+	int capacity;
+	int slotsUsed;            // Slots holding rings or kept for them by reserveRingGroups
+	float* x;                 // Distance along the course
+	float* y;                 // Height
+	float* z;                 // Left/right
+	float* angle;             // Spin about the vertical, in degrees
+	unsigned int* direction;  // All ones while a bouncing ring moves up or right, else 0
+	unsigned char* movement;  // A ringMovement
+	int* ring;                // Which ring (in flying order) is in each slot
+	int* slot;                // Which slot each ring is in
+	bool grouped;             // Slots are grouped by movement
+	int groupStart[RING_MOVEMENTS + 1]; // First slot of each movement's group, then slotsUsed
+	int groupEnd[RING_MOVEMENTS];       // Slot after the last ring in each group
+	void* block;              // Holds all of the above
+	Arena* arena;             // Where block comes from, NULL for the heap
+
+	RingStore(Arena* arena = NULL);
+	~RingStore();
+
+private:
+	RingStore(const RingStore&);
+	RingStore& operator=(const RingStore&);
+};
+
+//How far bouncing rings go and how fast everything moves each step
+struct RingLimits{
+	float minY, maxY;
+	float minZ, maxZ;
+	float step; // Distance a bouncing ring moves
+	float spin; // Degrees a spinning ring turns
+};
+
+//Makes room for at least capacity rings, keeping the ones already there
+void reserveRings(RingStore& rings, int capacity);
+
+//Empties rings and keeps counts[m] slots for rings with movement m, so
+//adding exactly that many of each (in flying order) needs no further
+//allocation and leaves them grouped
+void reserveRingGroups(RingStore& rings, const int counts[RING_MOVEMENTS]);
+
+//Adds a still, unturned ring after the last one, moving up or right if it
+//bounces. Returns its index in flying order. It goes in its group if a slot
+//was kept for it, otherwise in the next free slot until the rings are
+//grouped again
+int addRing(RingStore& rings, float x, float y, float z, ringMovement movement);
+
+//Puts the slots in groups by movement. stepRings does this itself if rings
+//have been added since, but slots change when it happens
+void groupRings(RingStore& rings);
+
+//Drops the first count rings (in flying order), renumbering the rest from 0,
+//and shares the free slots out evenly between the groups. Nothing is
+//allocated, so a store reserved once can be refilled for ever
+void recycleRings(RingStore& rings, int count);
+
+//Makes sure counts[m] more rings with movement m can be added while rings stay
+//grouped, growing the arrays only if all of them don't fit. The groups are laid
+//out again when one is short, with the rest of the free slots shared out evenly
+void reserveRingRoom(RingStore& rings, const int counts[RING_MOVEMENTS]);
+
+//How many more rings with movement can be added before rings stops being
+//grouped
+int getRingRoom(const RingStore& rings, ringMovement movement);
+
+//Replaces the rings in to with a copy of from
+void copyRings(const RingStore& from, RingStore& to);
+
+//Exchanges the rings in a and b, arrays and all, without copying them
+void swapRings(RingStore& a, RingStore& b);
+
+//Removes every ring, keeping the arrays for reuse
+void emptyRings(RingStore& rings);
+
+//Removes every ring and frees the arrays (unless an arena owns them)
+void clearRings(RingStore& rings);
+
+//Moves every ring from first (in flying order) on by one step: bouncing rings
+//turn round once past a limit, spinning ones wrap at a full turn
+void stepRings(RingStore& rings, int first, const RingLimits& limits);
+
+//Same as stepRings but never uses AVX, for comparing the two
+void stepRingsScalar(RingStore& rings, int first, const RingLimits& limits);
+
+#endif /* RINGS_H_ */
@@ -0,0 +1,54 @@
+/*
+ * texconv.cpp
+ *
+ * Offline converter: bakes the mipmap container (see mipmap.h) for each bitmap
+ * named on the command line, so the game never has to build one at startup.
+ *
+ *   texconv raptor.bmp sky.bmp ground.bmp
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "imageloader.h"
+#include "mipmap.h"
+#include "platform.h"
+
+int main(int argc, char **argv)
+{
+	if(argc < 2)
+	{
+		fputs("Usage: texconv image.bmp...\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	int failures = 0;
+	for(int i = 1; i < argc; i++)
+	{
+		unsigned long long sourceSize, sourceTime;
+		Image *img = NULL;
+		if(getFileInfo(argv[i], sourceSize, sourceTime))
+			img = loadBMP(argv[i], true);
+		if(img == NULL)
+		{
+			fprintf(stderr, "Error, could not read %s.\n", argv[i]);
+			failures++;
+			continue;
+		}
+
+		double startTime = getSeconds();
+		MipChain chain;
+		buildMipChain(*img, chain);
+		std::string mipName = getMipFileName(argv[i]);
+		if(writeMipFile(chain, mipName.c_str(), sourceSize, sourceTime))
+		{
+			printf("%s: %dx%d -> %dx%d, %d levels, %d bytes in %.1f ms\n", mipName.c_str(), img->width, img->height,
+				chain.levels[0].width, chain.levels[0].height, (int)chain.levels.size(), (int)chain.pixels.size(),
+				(getSeconds() - startTime)*1000.0);
+		} else {
+			failures++;
+		}
+		delete img;
+	}
+
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,187 @@
+/*
+ * texupload.cpp
+ */
+
+#include "texupload.h"
+#include <stdio.h>
+#include <string.h>
+#include <deque>
+#include <unordered_map>
+
+namespace {
+	struct PendingUpload{
+		GLuint texture;
+		const unsigned char* pixels;
+		std::vector<MipLevel> levels;
+		int channels;
+		int next;        // Next level to upload; they go smallest first
+		size_t heldBytes;
+		std::function<void(void)> release;
+	};
+
+	struct UploadQueue{
+		std::deque<PendingUpload> pending;
+		std::unordered_map<GLuint, size_t> uploaded; // GPU bytes of each texture so far
+		size_t budget;
+		GLuint buffer;   // Pixel buffer object the levels are staged through
+		TextureUploadStats stats;
+
+		UploadQueue() : budget(0), buffer(0)
+		{
+			memset(&stats, 0, sizeof(stats));
+		}
+	};
+
+	/* Never destroyed, so textures released by other files' globals at exit can still be forgotten */
+	UploadQueue& queue = *new UploadQueue;
+
+	void uploadLevel(PendingUpload& upload, int index)
+	{
+		const MipLevel& level = upload.levels[index];
+		GLenum format = upload.channels == 4 ? GL_RGBA : GL_RGB;
+		const unsigned char* source = upload.pixels + level.offset;
+
+		bool staged = false;
+		if(glPixelBuffersSupported)
+		{
+			if(queue.buffer == 0)
+				pglGenBuffers(1, &queue.buffer);
+			pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, queue.buffer);
+
+			/* Respecifying the store lets the driver hand back fresh memory
+			   while the previous level is still being transferred */
+			pglBufferData(GL_PIXEL_UNPACK_BUFFER, level.size, NULL, GL_STREAM_DRAW);
+			void* mapped = pglMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+			if(mapped != NULL)
+			{
+				memcpy(mapped, source, level.size);
+				staged = pglUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+			}
+			if(staged)
+				glTexImage2D(GL_TEXTURE_2D, index, 3, level.width, level.height, 0, format, GL_UNSIGNED_BYTE, (const void*)0);
+			pglBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+		if(!staged)
+			glTexImage2D(GL_TEXTURE_2D, index, 3, level.width, level.height, 0, format, GL_UNSIGNED_BYTE, source);
+
+		size_t gpuBytes = (size_t)level.width*level.height*3;
+		queue.uploaded[upload.texture] += gpuBytes;
+		queue.stats.gpu_bytes += gpuBytes;
+		queue.stats.uploaded_bytes += level.size;
+		queue.stats.levels++;
+	}
+
+	void releaseUpload(PendingUpload& upload)
+	{
+		queue.stats.cpu_bytes -= upload.heldBytes;
+		queue.stats.pending--;
+		if(upload.release)
+			upload.release();
+	}
+
+	/* Uploads levels of the front texture until it's done or budget runs
+	   out (spent counts what this frame has uploaded). Returns true if the
+	   texture is done */
+	bool uploadLevels(PendingUpload& upload, size_t& spent)
+	{
+		glBindTexture(GL_TEXTURE_2D, upload.texture);
+		while(upload.next >= 0)
+		{
+			size_t size = upload.levels[upload.next].size;
+			if(queue.budget != 0 && spent != 0 && spent + size > queue.budget)
+				break;
+			uploadLevel(upload, upload.next);
+			spent += size;
+
+			/* Draw from the finest level that's there so far */
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, upload.next);
+			upload.next--;
+		}
+		return upload.next < 0;
+	}
+}
+
+void setTextureUploadBudget(size_t bytesPerFrame)
+{
+	queue.budget = bytesPerFrame;
+}
+
+void queueTextureUpload(GLuint texture, const unsigned char* pixels, const MipLevel* levels, int levelCount, int channels, const std::function<void(void)>& release)
+{
+	PendingUpload upload;
+	upload.texture = texture;
+	upload.pixels = pixels;
+	upload.levels.assign(levels, levels + levelCount);
+	upload.channels = channels;
+	upload.next = levelCount - 1;
+	upload.heldBytes = 0;
+	for(int i = 0; i < levelCount; i++)
+		upload.heldBytes += levels[i].size;
+	upload.release = release;
+
+	queue.stats.pending++;
+	queue.stats.cpu_bytes += upload.heldBytes;
+	if(queue.stats.cpu_bytes > queue.stats.peak_cpu_bytes)
+		queue.stats.peak_cpu_bytes = queue.stats.cpu_bytes;
+	queue.stats.pixel_buffers = glPixelBuffersSupported != FALSE;
+
+	/* Without a budget there's no reason to wait for the next frame */
+	if(queue.budget == 0)
+	{
+		size_t spent = 0;
+		uploadLevels(upload, spent);
+		releaseUpload(upload);
+		return;
+	}
+	queue.pending.push_back(upload);
+}
+
+bool pumpTextureUploads(void)
+{
+	if(queue.pending.empty())
+		return false;
+
+	size_t spent = 0;
+	while(!queue.pending.empty() && uploadLevels(queue.pending.front(), spent))
+	{
+		releaseUpload(queue.pending.front());
+		queue.pending.pop_front();
+	}
+	queue.stats.frames++;
+	return queue.pending.empty();
+}
+
+void forgetTexture(GLuint texture)
+{
+	for(std::deque<PendingUpload>::iterator upload = queue.pending.begin(); upload != queue.pending.end(); )
+	{
+		if(upload->texture == texture)
+		{
+			releaseUpload(*upload);
+			upload = queue.pending.erase(upload);
+		} else {
+			++upload;
+		}
+	}
+
+	std::unordered_map<GLuint, size_t>::iterator uploaded = queue.uploaded.find(texture);
+	if(uploaded != queue.uploaded.end())
+	{
+		queue.stats.gpu_bytes -= uploaded->second;
+		queue.uploaded.erase(uploaded);
+	}
+}
+
+TextureUploadStats getTextureUploadStats(void)
+{
+	return queue.stats;
+}
+
+void printTextureUploadStats(void)
+{
+	const TextureUploadStats& stats = queue.stats;
+	printf("Texture uploads: %u levels (%.1f KB) over %u frames%s, %d pending\n", stats.levels, stats.uploaded_bytes/1024.0,
+		stats.frames, stats.pixel_buffers ? " through pixel buffers" : "", stats.pending);
+	printf("Texture memory: %.1f KB on the GPU, %.1f KB of pixels held in memory (peak %.1f KB)\n",
+		stats.gpu_bytes/1024.0, stats.cpu_bytes/1024.0, stats.peak_cpu_bytes/1024.0);
+}
@@ -0,0 +1,56 @@
+/*
+ * texupload.h
+ *
+ * Hands texture pixels to the GPU and then lets go of them. A texture's mipmap
+ * levels are queued along with a function that frees whatever holds their
+ * pixels, which is called as soon as the last level is uploaded, so no decoded
+ * copy stays in memory once the GPU has it. Where the driver has pixel buffer
+ * objects each level is copied into one first, so glTexImage2D returns without
+ * waiting for the transfer.
+ *
+ * With a per-frame budget, levels go up smallest first a few per frame and the
+ * texture's base level follows them down: it can be drawn (blurry) as soon as
+ * the smallest levels are in, and sharpens as the larger ones arrive.
+ *
+ * Everything here runs on the thread that owns the GL context.
+ */
+
+#ifndef TEXUPLOAD_H_
+#define TEXUPLOAD_H_
+
+#include <functional>
+#include "glfuncs.h"
+#include "mipmap.h"
+
+struct TextureUploadStats{
+	int pending;            // Textures with levels still to upload
+	size_t cpu_bytes;       // Pixels held for uploads still pending
+	size_t peak_cpu_bytes;
+	size_t gpu_bytes;       // Uploaded levels of textures still alive
+	size_t uploaded_bytes;  // Everything ever uploaded
+	unsigned int levels;    // Levels uploaded
+	unsigned int frames;    // Calls to pumpTextureUploads that uploaded anything
+	bool pixel_buffers;     // Uploads go through pixel buffer objects
+};
+
+//Bytes pumpTextureUploads may upload each frame (at least one level always
+//goes). 0, the default, uploads each texture whole as soon as it's queued
+void setTextureUploadBudget(size_t bytesPerFrame);
+
+//Queues levels (largest first, as in a MipChain) for texture, whose
+//parameters should already be set. GL level i is levels[i]. release is
+//called once they're all uploaded, or if the texture is forgotten first
+void queueTextureUpload(GLuint texture, const unsigned char* pixels, const MipLevel* levels, int levelCount, int channels, const std::function<void(void)>& release);
+
+//Uploads as much of the queue as the budget allows. Returns true if that
+//finished the last pending texture. Call once a frame
+bool pumpTextureUploads(void);
+
+//Drops anything still queued for texture and stops counting its memory. Call
+//before deleting it
+void forgetTexture(GLuint texture);
+
+TextureUploadStats getTextureUploadStats(void);
+void printTextureUploadStats(void);
+
+#endif /* TEXUPLOAD_H_ */
@@ -0,0 +1,51 @@
+/*
+ * tilecut.cpp
+ *
+ * Offline cutter: turns a large ground image into the tile set (see tileset.h)
+ * the game streams the floor from.
+ *
+ *   tilecut aerial.bmp ground.tiles [tile size]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "imageloader.h"
+#include "platform.h"
+#include "tileset.h"
+
+#define DEFAULT_TILE_SIZE 256
+
+int main(int argc, char **argv)
+{
+	if(argc < 3 || argc > 4)
+	{
+		fputs("Usage: tilecut image.bmp output.tiles [tile size]\n", stderr);
+		return EXIT_FAILURE;
+	}
+	int tileSize = argc == 4 ? atoi(argv[3]) : DEFAULT_TILE_SIZE;
+
+	Image *img = loadBMP(argv[1]);
+	if(img == NULL)
+	{
+		fprintf(stderr, "Error, could not read %s.\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	double startTime = getSeconds();
+	bool ok = writeTileSet(*img, tileSize, argv[2]);
+	delete img;
+	if(!ok)
+		return EXIT_FAILURE;
+
+	TileSet tiles;
+	if(!openTileSet(tiles, argv[2]))
+	{
+		fprintf(stderr, "Error, could not read back %s.\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+	printf("%s: %d levels, %d tiles of %dx%d (%d across the finest level), %.1f MB in %.1f ms\n", argv[2],
+		tiles.levels, getTileCount(tiles), tiles.tileSize, tiles.tileSize, getTilesAcross(tiles, 0),
+		tiles.file.size/(1024.0*1024.0), (getSeconds() - startTime)*1000.0);
+	closeTileSet(tiles);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,225 @@
+/*
+ * tileset.cpp
+ */
+
+#include "tileset.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace {
+	const char tileSetMagic[8] = {'T','I','L','E','S','E','T','\0'};
+	const unsigned int tileSetVersion = 1;
+
+	//Header of a tile set file, followed by every tile's mipmap chain in
+	//getTileIndex order
+	struct TileSetHeader{
+		char magic[8];
+		unsigned int version;
+		unsigned int headerSize;
+		unsigned int tileSize;
+		unsigned int border;
+		unsigned int channels;
+		unsigned int levels;
+		unsigned long long tileBytes;
+	};
+
+	/* Lays out a tile's mipmaps, returning their total size */
+	size_t layoutTileMips(int tileSize, MipLevel* mips, int& mipCount)
+	{
+		size_t total = 0;
+		mipCount = 0;
+		for(int size = tileSize; mipCount < MAX_MIP_LEVELS; size /= 2)
+		{
+			MipLevel& mip = mips[mipCount++];
+			mip.width = mip.height = size;
+			mip.offset = total;
+			mip.size = (size_t)size*size*TILESET_CHANNELS;
+			total += mip.size;
+			if(size == 1)
+				break;
+		}
+		return total;
+	}
+
+	/* Copies tile (x, y) of a size x size level, border included, clamping at
+	   the level's edges */
+	void cutTile(const unsigned char* level, int size, int tileSize, int x, int y, unsigned char* tile)
+	{
+		int content = tileSize - 2*TILESET_BORDER;
+		for(int j = 0; j < tileSize; j++)
+		{
+			int row = y*content + j - TILESET_BORDER;
+			row = row < 0 ? 0 : (row >= size ? size - 1 : row);
+			for(int i = 0; i < tileSize; i++)
+			{
+				int column = x*content + i - TILESET_BORDER;
+				column = column < 0 ? 0 : (column >= size ? size - 1 : column);
+				memcpy(tile + ((size_t)j*tileSize + i)*TILESET_CHANNELS, level + ((size_t)row*size + column)*TILESET_CHANNELS, TILESET_CHANNELS);
+			}
+		}
+	}
+}
+
+int getTilesAcross(const TileSet& tiles, int level)
+{
+	return 1 << (tiles.levels - 1 - level);
+}
+
+int getTileIndex(const TileSet& tiles, int level, int x, int y)
+{
+	int index = 0;
+	for(int l = 0; l < level; l++)
+		index += getTilesAcross(tiles, l)*getTilesAcross(tiles, l);
+	return index + y*getTilesAcross(tiles, level) + x;
+}
+
+int getTileCount(const TileSet& tiles)
+{
+	return getTileIndex(tiles, tiles.levels, 0, 0);
+}
+
+const unsigned char* getTilePixels(const TileSet& tiles, int index)
+{
+	return tiles.pixels + (size_t)index*tiles.tileBytes;
+}
+
+bool writeTileSet(const Image& image, int tileSize, const char* filename)
+{
+	int content = tileSize - 2*TILESET_BORDER;
+	if(content <= 0 || (tileSize & (tileSize - 1)) != 0)
+	{
+		printf("Tile size %d is not a power of two larger than the border\n", tileSize);
+		return false;
+	}
+
+	/* Enough tiles across (a power of two, so every level halves exactly) to
+	   keep every pixel of the image */
+	int longest = image.width > image.height ? image.width : image.height;
+	int across = 1, levels = 1;
+	while(across*content < longest)
+	{
+		across *= 2;
+		levels++;
+	}
+
+	MipLevel mips[MAX_MIP_LEVELS];
+	int mipCount;
+	size_t tileBytes = layoutTileMips(tileSize, mips, mipCount);
+
+	/* Level 0: the image as RGBA, stretched to the square the tiles cover */
+	const unsigned char* source = (const unsigned char*)image.pixels;
+	std::vector<unsigned char> rgba;
+	if(image.channels != TILESET_CHANNELS)
+	{
+		size_t count = (size_t)image.width*image.height;
+		rgba.resize(count*TILESET_CHANNELS);
+		for(size_t i = 0; i < count; i++)
+		{
+			memcpy(&rgba[i*TILESET_CHANNELS], source + i*image.channels, 3);
+			rgba[i*TILESET_CHANNELS + 3] = 255;
+		}
+		source = &rgba[0];
+	}
+	int size = across*content;
+	std::vector<unsigned char> level((size_t)size*size*TILESET_CHANNELS), smaller;
+	resizeImage(source, image.width, image.height, TILESET_CHANNELS, &level[0], size, size);
+	std::vector<unsigned char>().swap(rgba);
+
+	FILE* filePtr = fopen(filename, "wb");
+	if(filePtr == NULL)
+	{
+		printf("Could not write tile set %s\n", filename);
+		return false;
+	}
+
+	TileSetHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, tileSetMagic, sizeof(tileSetMagic));
+	header.version = tileSetVersion;
+	header.headerSize = sizeof(TileSetHeader);
+	header.tileSize = tileSize;
+	header.border = TILESET_BORDER;
+	header.channels = TILESET_CHANNELS;
+	header.levels = levels;
+	header.tileBytes = tileBytes;
+	bool ok = fwrite(&header, sizeof(header), 1, filePtr) == 1;
+
+	std::vector<unsigned char> tile(tileBytes);
+	for(int l = 0; ok && l < levels; l++)
+	{
+		if(l > 0)
+		{
+			smaller.resize((size_t)(size/2)*(size/2)*TILESET_CHANNELS);
+			halveImage(&level[0], size, size, TILESET_CHANNELS, &smaller[0]);
+			level.swap(smaller);
+			size /= 2;
+		}
+
+		int tilesAcross = across >> l;
+		for(int y = 0; ok && y < tilesAcross; y++)
+		{
+			for(int x = 0; ok && x < tilesAcross; x++)
+			{
+				cutTile(&level[0], size, tileSize, x, y, &tile[0]);
+				for(int m = 1; m < mipCount; m++)
+					halveImage(&tile[mips[m - 1].offset], mips[m - 1].width, mips[m - 1].height, TILESET_CHANNELS, &tile[mips[m].offset]);
+				ok = fwrite(&tile[0], tileBytes, 1, filePtr) == 1;
+			}
+		}
+	}
+
+	if(fclose(filePtr) != 0)
+		ok = false;
+	if(!ok)
+	{
+		printf("Could not write tile set %s\n", filename);
+		remove(filename);
+	}
+	return ok;
+}
+
+bool openTileSet(TileSet& tiles, const char* filename)
+{
+	if(!openMappedFile(tiles.file, filename))
+		return false;
+
+	TileSetHeader header;
+	bool valid = tiles.file.size >= sizeof(TileSetHeader);
+	if(valid)
+	{
+		memcpy(&header, tiles.file.data, sizeof(TileSetHeader));
+		valid = memcmp(header.magic, tileSetMagic, sizeof(tileSetMagic)) == 0
+			&& header.version == tileSetVersion
+			&& header.headerSize == sizeof(TileSetHeader)
+			&& header.border == TILESET_BORDER
+			&& header.channels == TILESET_CHANNELS
+			&& header.tileSize > 2*TILESET_BORDER && header.tileSize <= 4096
+			&& (header.tileSize & (header.tileSize - 1)) == 0
+			&& header.levels >= 1 && header.levels <= MAX_MIP_LEVELS;
+	}
+	if(valid)
+	{
+		tiles.tileSize = header.tileSize;
+		tiles.levels = header.levels;
+		tiles.tileBytes = layoutTileMips(tiles.tileSize, tiles.mips, tiles.mipCount);
+
+		/* Every tile has to lie inside the file */
+		valid = header.tileBytes == tiles.tileBytes
+			&& (tiles.file.size - sizeof(TileSetHeader))/tiles.tileBytes >= (size_t)getTileCount(tiles);
+	}
+
+	if(!valid)
+	{
+		closeMappedFile(tiles.file);
+		return false;
+	}
+	tiles.pixels = (const unsigned char*)tiles.file.data + sizeof(TileSetHeader);
+	return true;
+}
+
+void closeTileSet(TileSet& tiles)
+{
+	closeMappedFile(tiles.file);
+	tiles.pixels = NULL;
+}
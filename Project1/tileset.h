@@ -0,0 +1,56 @@
+/*
+ * tileset.h
+ *
+ * A large image cut into a pyramid of square tiles, so it can be streamed in a
+ * piece at a time rather than loaded whole. Level 0 is the image at full size;
+ * each level above halves it, down to a single tile covering everything. The
+ * tiles of level l form a (1 << (levels - 1 - l)) square grid.
+ *
+ * Each tile carries a border of its neighbours' pixels, so tiles drawn side by
+ * side filter across the join without seams, and its own mipmap chain, so it
+ * can go straight to glTexImage2D. The file (made by tilecut) is mapped and a
+ * tile's pixels read from it on demand.
+ */
+
+#ifndef TILESET_H_
+#define TILESET_H_
+
+#include "imageloader.h"
+#include "mipmap.h"
+#include "platform.h"
+
+#define TILESET_BORDER 1 // Pixels of the neighbouring tiles around each one
+#define TILESET_CHANNELS 4 // RGBA, so every mipmap's rows are 4 byte aligned
+
+struct TileSet{
+	MappedFile file;
+	int tileSize;       // Pixels across a tile, border included (a power of two)
+	int levels;
+	size_t tileBytes;   // Size of a tile's whole mipmap chain
+	int mipCount;
+	MipLevel mips[MAX_MIP_LEVELS]; // Offsets from the start of a tile
+	const unsigned char* pixels;   // First tile (level 0, 0, 0)
+};
+
+//Number of tiles across level
+int getTilesAcross(const TileSet& tiles, int level);
+
+//Position of a tile among all the tiles in the set, finest level first
+int getTileIndex(const TileSet& tiles, int level, int x, int y);
+
+int getTileCount(const TileSet& tiles);
+
+//Start of a tile's mipmap chain in the mapped file
+const unsigned char* getTilePixels(const TileSet& tiles, int index);
+
+//Cuts image into tiles of tileSize pixels (a power of two) and writes them to
+//filename. The image is stretched to the square the finest level covers.
+//Returns false (leaving no file) on failure
+bool writeTileSet(const Image& image, int tileSize, const char* filename);
+
+//Maps a file written by writeTileSet. Returns false if it's missing or damaged
+bool openTileSet(TileSet& tiles, const char* filename);
+
+void closeTileSet(TileSet& tiles);
+
+#endif /* TILESET_H_ */